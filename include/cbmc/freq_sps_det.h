@@ -45,11 +45,66 @@ namespace gr {
        * constructor is in a private implementation
        * class. cbmc::freq_sps_det::make is the public interface for
        * creating new instances.
+       *
+       * \param decimation (int) Samples per estimate.
+       * \param fft_size (int) Subdivisions of the refined frequency search, 1 for none.
+       * \param probe_capacity (size_t) Offsets stored until they are
+       *        drained (default = 65536).
        */
-      static sptr make(int decimation, int fft_size);
+      static sptr make(int decimation, int fft_size, size_t probe_capacity=65536);
 
+      /*!
+       * \brief Returns the stored frequency offsets, oldest first
+       *
+       * One offset in cycles per sample is stored per decimation
+       * block, up to probe_capacity until they are drained or
+       * discarded. Later offsets are dropped and counted by
+       * get_probe_overflows().
+       */
       virtual std::vector<float> get_stored_freqs() const = 0;
+
+      /*!
+       * \brief Returns and removes the stored frequency offsets
+       */
+      virtual std::vector<float> drain_stored_freqs() = 0;
+
+      /*!
+       * \brief Moves up to \p max stored offsets into \p out
+       *
+       * Returns the number written, oldest first. From Python, \p out
+       * and \p max are one writable float32 buffer such as a NumPy
+       * array, so polling allocates nothing.
+       */
+      virtual size_t drain_stored_freqs_into(float *out, size_t max) = 0;
       virtual void discard_stored_freqs() = 0;
+
+      /*!
+       * \brief Returns the number of offsets dropped on a full store
+       */
+      virtual uint64_t get_probe_overflows() const = 0;
+
+      /*!
+       * \brief Returns the number of decimation blocks estimated
+       */
+      virtual uint64_t get_blocks_processed() const = 0;
+
+      /*!
+       * \brief Returns the seconds spent estimating and correcting
+       *
+       * Divided by get_blocks_processed() this is the time per block,
+       * which has to stay below decimation / sample rate.
+       */
+      virtual double get_estimator_time() const = 0;
+
+      /*!
+       * \brief Returns the number of "det_sps" tags added
+       */
+      virtual uint64_t get_tags_emitted() const = 0;
+
+      /*!
+       * \brief Sets all performance counters to 0
+       */
+      virtual void reset_counters() = 0;
     };
 
   } // namespace cbmc
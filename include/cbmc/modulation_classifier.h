@@ -45,12 +45,94 @@ namespace gr {
        * constructor is in a private implementation
        * class. cbmc::modulation_classifier::make is the public interface for
        * creating new instances.
+       *
+       * \param decimation (int) Samples per classified block.
+       * \param probe (bool) Store the decision and |C40| of every block.
+       * \param probe_capacity (size_t) Blocks stored until the probes
+       *        are drained (default = 65536).
        */
-      static sptr make(int decimation, bool probe);
+      static sptr make(int decimation, bool probe, size_t probe_capacity=65536);
 
+      /*!
+       * \brief Returns the stored modulation indexes, oldest first
+       *
+       * With probe enabled the decision (0: 8PSK, 1: 16QAM, 2: QPSK,
+       * 3: BPSK) and |C40| of every block are stored as one entry, up
+       * to probe_capacity until they are drained or reset. Later blocks
+       * are dropped and counted by get_probe_overflows(). Both are
+       * always stored for the same blocks: draining either one removes
+       * the entries of both, so a poller drains one and reads the other
+       * with get_stored_*() first if it needs both.
+       */
       virtual std::vector<unsigned int> get_stored_mod() const = 0;
+
+      /*!
+       * \brief Returns the stored |C40| values, oldest first
+       */
       virtual std::vector<float> get_stored_cumu() const = 0;
+
+      /*!
+       * \brief Returns and removes the stored modulation indexes
+       */
+      virtual std::vector<unsigned int> drain_stored_mod() = 0;
+
+      /*!
+       * \brief Returns and removes the stored |C40| values
+       */
+      virtual std::vector<float> drain_stored_cumu() = 0;
+
+      /*!
+       * \brief Moves up to \p max stored modulation indexes into \p out
+       *
+       * Returns the number written, oldest first. From Python, \p out
+       * and \p max are one writable uint32 buffer such as a NumPy
+       * array, so polling allocates nothing.
+       */
+      virtual size_t drain_stored_mod_into(unsigned int *out, size_t max) = 0;
+
+      /*!
+       * \brief Moves up to \p max stored |C40| values into a float32
+       * buffer, see drain_stored_mod_into()
+       */
+      virtual size_t drain_stored_cumu_into(float *out, size_t max) = 0;
+
+      /*!
+       * \brief Returns the number of blocks dropped on a full store
+       */
+      virtual uint64_t get_probe_overflows() const = 0;
+
+      /*!
+       * \brief Returns the SNR in dB of the last classified block.
+       *
+       * The estimate is the M2M4 estimator computed from the second
+       * and fourth order moments used for the cumulants. It is also
+       * published as "snr" stream tag next to "det_mod".
+       */
+      virtual float get_snr() const = 0;
       virtual void reset() = 0;
+
+      /*!
+       * \brief Returns the number of decimation blocks classified
+       */
+      virtual uint64_t get_blocks_processed() const = 0;
+
+      /*!
+       * \brief Returns the seconds spent on cumulants, phase and SNR
+       *
+       * Divided by get_blocks_processed() this is the time per block,
+       * which has to stay below decimation / sample rate.
+       */
+      virtual double get_estimator_time() const = 0;
+
+      /*!
+       * \brief Returns the number of "det_mod" and "snr" tags added
+       */
+      virtual uint64_t get_tags_emitted() const = 0;
+
+      /*!
+       * \brief Sets all performance counters to 0
+       */
+      virtual void reset_counters() = 0;
     };
 
   } // namespace cbmc
@@ -31,6 +31,36 @@
 namespace gr {
   namespace cbmc {
 
+    /*!
+     * \brief Interpolation engine of the timing synchronizer
+     * \ingroup cbmc
+     */
+    enum interp_type {
+      INTERP_PFB = 0,   //!< polyphase filterbank with filter_size arms
+      INTERP_CUBIC = 1  //!< single matched filter and cubic Farrow interpolator
+    };
+
+    /*!
+     * \brief Timing error detector of the timing synchronizer
+     * \ingroup cbmc
+     */
+    enum ted_type {
+      TED_ML = 0,                //!< maximum likelihood, uses the derivative filterbank
+      TED_GARDNER = 1,           //!< Gardner, matched output at half symbol spacing
+      TED_MUELLER_MULLER = 2     //!< Mueller and Mueller, decision directed
+    };
+
+    /*!
+     * \brief Span and window presets of the designed matched filter
+     * \ingroup cbmc
+     */
+    enum mf_preset {
+      MF_LEGACY = 0,     //!< 45 taps per arm whatever the sps, no window
+      MF_ACCURATE = 1,   //!< 12 symbols, Blackman-Harris window
+      MF_BALANCED = 2,   //!< 8 symbols, Hamming window
+      MF_FAST = 3        //!< 6 symbols, Hamming window
+    };
+
     /*!
      * \brief Timing synchronizer using polyphase filterbanks
      * \ingroup synchronizers_blk
@@ -146,6 +176,42 @@ namespace gr {
      * was added to better work with equalizers, which do a better job
      * of modeling the channel if they have 2 samps/sym.
      *
+     * \li \p interp (default=INTERP_PFB): The interpolation engine.
+     * INTERP_PFB uses the two polyphase filterbanks described
+     * above. INTERP_CUBIC runs a single matched filter at the input
+     * rate and interpolates between its outputs with a cubic Farrow
+     * structure, which also yields the derivative for the error
+     * signal. The filter_size then only sets the units of the phase
+     * d_k, so tap memory and the cost of a retune do not grow with
+     * the timing resolution.
+     *
+     * \li \p ted (default=TED_ML): The timing error detector. TED_ML
+     * is the derivative based error described above. TED_GARDNER
+     * uses the matched filter output half a symbol between two
+     * symbols, e[n] = Re{(y[n-1] - y[n]) * conj(y[n-1/2])} / 2, and
+     * TED_MUELLER_MULLER the decision directed error
+     * e[n] = Re{y[n] * conj(d[n-1]) - y[n-1] * conj(d[n])} / 2 with
+     * sign decisions d on I and Q. Both only need the matched filter,
+     * which halves the filtering work of INTERP_PFB. Their error
+     * gains differ from TED_ML, so the loop bandwidth may need to be
+     * adjusted.
+     *
+     * \li \p rolloff (default=0.35), \p span (default=0) and \p window
+     * (default=-1): The root raised cosine designed for each sps. The
+     * span is the length of each arm in symbols, so an arm has about
+     * span*sps taps; 0 keeps 45 taps per arm whatever the sps. The
+     * window is a filter::firdes::win_type applied to the prototype,
+     * -1 for none. A short windowed filter costs a little stopband
+     * rejection and saves filtering work on every symbol, see
+     * mf_preset for typical choices.
+     *
+     * The loop state can be saved with loop_state() and restored with
+     * set_loop_state(), or through the message ports: a dictionary
+     * sent to "state_in" is restored, and any other message to
+     * "state_in" publishes the current state on "state_out". A bad
+     * dictionary on "state_in" is logged and ignored. This lets a
+     * receiver resume at its last lock point after a restart.
+     *
      * Reference:
      * f. j. harris and M. Rice, "Multirate Digital Filters for Symbol
      * Timing Synchronization in Software Defined Radios", IEEE
@@ -169,13 +235,26 @@ namespace gr {
        *                           with (default = 0).
        * \param max_rate_deviation (float) Distance from 0 d_rate can get (default = 1.5).
        * \param osps (int) The number of output samples per symbol (default=1).
+       * \param d_det_block_size (uint) Range in items searched for "det_sps" tags.
+       * \param interp (interp_type) The interpolation engine (default = INTERP_PFB).
+       * \param ted (ted_type) The timing error detector (default = TED_ML).
+       * \param rolloff (float) Excess bandwidth of the matched filter (default = 0.35).
+       * \param span (float) Matched filter length in symbols, 0 for 45 taps per arm
+       *                     (default = 0).
+       * \param window (int) filter::firdes::win_type of the matched filter,
+       *                     -1 for none (default = -1).
        */
       static sptr make(double sps, float loop_bw,
 		       unsigned int filter_size=32,
 		       float init_phase=0,
 		       float max_rate_deviation=1.5,
 		       int osps=1,
-		       unsigned int d_det_block_size=10000);
+		       unsigned int d_det_block_size=10000,
+		       interp_type interp=INTERP_PFB,
+		       ted_type ted=TED_ML,
+		       float rolloff=0.35,
+		       float span=0,
+		       int window=-1);
 
       /*! \brief update the system gains from omega and eta
        *
@@ -222,6 +301,30 @@ namespace gr {
        */
       virtual std::vector<float> diff_channel_taps(int channel) const = 0;
 
+      /*!
+       * Returns the number of filters and the taps per filter
+       */
+      virtual std::vector<int> taps_shape() const = 0;
+
+      /*!
+       * \brief Copies the taps of the matched filter into \p out
+       *
+       * Filter i occupies out[i*taps_per_filter ...], the layout of
+       * taps() flattened. The taps are only written if \p max leaves
+       * room for all of them; the return value is their number, so a
+       * caller can retry after a retune changed the filter length.
+       *
+       * From Python, \p out and \p max are one writable float32 buffer
+       * such as a NumPy array, which is filled without building lists.
+       */
+      virtual size_t taps_into(float *out, size_t max) = 0;
+
+      /*!
+       * \brief Copies the taps of the derivative filter into \p out,
+       * see taps_into()
+       */
+      virtual size_t diff_taps_into(float *out, size_t max) = 0;
+
       /*!
        * Return the taps as a formatted string for printing
        */
@@ -295,6 +398,105 @@ namespace gr {
        */
       virtual void set_max_rate_deviation(float m) = 0;
 
+      /*!
+       * \brief Set the matched filter designed for each sps
+       *
+       * Drops all cached filterbanks and redesigns the filterbank of
+       * the current sps in the background. It is swapped in at the
+       * next symbol boundary.
+       *
+       * \param rolloff    (float) excess bandwidth, in (0, 1]
+       * \param span       (float) length in symbols, 0 for 45 taps per arm
+       * \param window     (int) filter::firdes::win_type, -1 for none
+       */
+      virtual void set_matched_filter(float rolloff, float span, int window) = 0;
+
+      /*!
+       * \brief Set span and window of the matched filter from a preset
+       *
+       * The roll-off is kept, it belongs to the received signal.
+       */
+      virtual void set_matched_filter_preset(mf_preset preset) = 0;
+
+      /*!
+       * \brief Set the decimation of the telemetry outputs
+       *
+       * The optional outputs err, rate and phase produce one item
+       * every \p decim symbols instead of one item per output
+       * sample. The loop statistics are still updated on every
+       * symbol. Takes effect at the next symbol boundary.
+       *
+       * \param decim    (int) symbols per telemetry item, >= 1
+       */
+      virtual void set_telemetry_decimation(int decim) = 0;
+
+      /*!
+       * \brief Set the acquisition loop bandwidth
+       *
+       * After a retune to a new sps or a "time_est" tag the loop runs
+       * with the gains of \p bw until the lock detector declares lock,
+       * then it shifts to the tracking gains of the loop bandwidth.
+       * 0 disables the gear shift and always uses the loop bandwidth.
+       * Only the acquisition gains are recomputed, tracking gains set
+       * with set_alpha() and set_beta() are kept.
+       *
+       * \param bw    (float) acquisition bandwidth, >= 0
+       */
+      virtual void set_acquisition_bandwidth(float bw) = 0;
+
+      /*!
+       * \brief Set the threshold of the lock detector
+       *
+       * The loop is locked once the smoothed squared timing error
+       * falls below \p th, and unlocked when it exceeds twice
+       * \p th. Lock changes are published as "clock_lock" stream tags
+       * on the output.
+       *
+       * \param th    (float) threshold on the mean squared error, > 0
+       */
+      virtual void set_lock_threshold(float th) = 0;
+
+      /*!
+       * \brief Bound the latency of the block
+       *
+       * Limits every call of the block to \p nsymbols symbols, so the
+       * scheduler neither waits for nor buffers more input than
+       * needed for them. 0 removes the limit. Takes effect with the
+       * next call of the block.
+       *
+       * \param nsymbols    (int) maximum symbols per call, >= 0
+       */
+      virtual void set_max_latency(int nsymbols) = 0;
+
+      /*!
+       * \brief Clears the running loop statistics and histograms
+       */
+      virtual void reset_statistics() = 0;
+
+      /*!
+       * \brief Sets all performance counters to 0
+       */
+      virtual void reset_counters() = 0;
+
+      /*!
+       * \brief Restore a loop state saved by loop_state()
+       *
+       * Sets the sps, phase and rate and the filterbank of the saved
+       * taps, which are used as they are without a new design. If the
+       * taps are missing or were saved with a different number of
+       * filters or interpolator, the filterbank of the sps is used. A
+       * locked state resumes with the tracking gains.
+       *
+       * A cached filterbank is used right away. Otherwise the bank is
+       * designed in the background and the state is restored when it
+       * is swapped in, at the next symbol boundary after the design.
+       * Throws std::invalid_argument if a key has the wrong type or
+       * an out of range value.
+       *
+       * \param state    (pmt dict) as returned by loop_state()
+       */
+      virtual void set_loop_state(pmt::pmt_t state) = 0;
+
       /*******************************************************************
        GET FUNCTIONS
       *******************************************************************/
@@ -338,6 +540,132 @@ namespace gr {
        * \brief Returns the current phase arm of the control loop.
        */
       virtual float phase() const = 0;
+
+      /*!
+       * \brief Returns the decimation of the telemetry outputs
+       */
+      virtual int telemetry_decimation() const = 0;
+
+      /*!
+       * \brief Returns the excess bandwidth of the matched filter
+       */
+      virtual float rolloff() const = 0;
+
+      /*!
+       * \brief Returns the matched filter length in symbols, 0 for 45 taps per arm
+       */
+      virtual float span() const = 0;
+
+      /*!
+       * \brief Returns the window of the matched filter, -1 for none
+       */
+      virtual int window() const = 0;
+
+      /*!
+       * \brief Returns the acquisition loop bandwidth, 0 if disabled
+       */
+      virtual float acquisition_bandwidth() const = 0;
+
+      /*!
+       * \brief Returns the threshold of the lock detector
+       */
+      virtual float lock_threshold() const = 0;
+
+      /*!
+       * \brief Returns true if the lock detector declares lock
+       */
+      virtual bool locked() const = 0;
+
+      /*!
+       * \brief Returns the maximum symbols per call, 0 if unbounded
+       */
+      virtual int max_latency() const = 0;
+
+      /*!
+       * \brief Returns the mean of the loop error since the last reset
+       */
+      virtual float error_mean() const = 0;
+
+      /*!
+       * \brief Returns the variance of the loop error since the last reset
+       */
+      virtual float error_variance() const = 0;
+
+      /*!
+       * \brief Returns the mean of the rate since the last reset
+       */
+      virtual float rate_mean() const = 0;
+
+      /*!
+       * \brief Returns the variance of the rate since the last reset
+       */
+      virtual float rate_variance() const = 0;
+
+      /*!
+       * \brief Returns the histogram of the loop error
+       *
+       * Counts of the loop error in equally spaced bins over [-2, 2],
+       * values outside are counted in the outer bins.
+       */
+      virtual std::vector<float> error_histogram() const = 0;
+
+      /*!
+       * \brief Returns the histogram of the rate
+       *
+       * Counts of the rate in equally spaced bins over
+       * [-max_rate_deviation, max_rate_deviation].
+       */
+      virtual std::vector<float> rate_histogram() const = 0;
+
+      /*!
+       * \brief Returns the loop state as a dictionary
+       *
+       * Keys are "sps" (double), "phase" and "rate" (float), "locked"
+       * (bool), "nfilters" (int) and "taps" (f32vector, the prototype
+       * of the active filterbank).
+       */
+      virtual pmt::pmt_t loop_state() const = 0;
+
+      /*!
+       * \brief Returns the number of symbols produced
+       */
+      virtual uint64_t symbols_produced() const = 0;
+
+      /*!
+       * \brief Returns the seconds spent in the loop
+       *
+       * Divided by symbols_produced() this is the time per symbol,
+       * which has to stay below sps / sample rate.
+       */
+      virtual double work_time() const = 0;
+
+      /*!
+       * \brief Returns the number of calls that produced no symbol
+       *
+       * A high share of all calls means the block is starved by the
+       * blocks before it, not that it is slow.
+       */
+      virtual uint64_t zero_output_calls() const = 0;
+
+      /*!
+       * \brief Returns the number of sps changes applied
+       */
+      virtual uint64_t retunes() const = 0;
+
+      /*!
+       * \brief Returns the number of filterbanks designed
+       */
+      virtual uint64_t banks_designed() const = 0;
+
+      /*!
+       * \brief Returns the seconds spent designing filterbanks
+       */
+      virtual double design_time() const = 0;
+
+      /*!
+       * \brief Returns the number of "clock_lock" tags added
+       */
+      virtual uint64_t tags_emitted() const = 0;
     };
 
   } // namespace cbmc
@@ -0,0 +1,190 @@
+/* -*- c++ -*- */
+/* 
+ * Copyright 2016 <+YOU OR YOUR COMPANY+>.
+ * 
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ * 
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+
+#ifndef INCLUDED_CBMC_MY_PFB_CLOCK_SYNC_MC_H
+#define INCLUDED_CBMC_MY_PFB_CLOCK_SYNC_MC_H
+
+#include <cbmc/api.h>
+#include <gnuradio/block.h>
+
+namespace gr {
+  namespace cbmc {
+
+    /*!
+     * \brief Input sample format of my_pfb_clock_sync_mc
+     * \ingroup cbmc
+     */
+    enum sample_format {
+      SAMPLES_FC32 = 0,   //!< complex float
+      SAMPLES_SC16 = 1    //!< interleaved int16 I and Q, full scale 32768
+    };
+
+    /*!
+     * \brief Polyphase timing synchronizer for several channels at one sps
+     * \ingroup synchronizers_blk
+     *
+     * \details
+     * Runs the maximum likelihood loop of my_pfb_clock_sync on each of
+     * \p nchannels input streams, typically the outputs of a
+     * channelizer. Every channel keeps its own phase, rate and error,
+     * while all channels read the same matched and derivative
+     * filterbank, so the taps are stored and designed once and stay
+     * in cache while the channels are processed in one call.
+     *
+     * Stream i is synchronized to output i, one sample per symbol.
+     * Channels consume and produce independently of each other.
+     *
+     * With SAMPLES_SC16 the inputs are sc16 items and the filterbank
+     * runs on Q15 taps with 16 bit multiply-accumulates into 32 bit
+     * sums, which halves the memory read per symbol. The outputs and
+     * the control loops stay float, sc16 full scale maps to 1.0. The
+     * taps are scaled so no input can overflow, by
+     *
+     *   scale = min(32767 / max|tap|, (65535 - n) / maxsum)
+     *
+     * with n the taps per filter and maxsum the largest sum of |tap|
+     * over the filters of a bank; for RRC banks the second term
+     * decides. Compared to the float path on the same samples, each
+     * filter output differs at most by n / (2 * scale) for full scale
+     * input, about 2e-4 to 7e-4 for RRC banks of 17 to 65 taps. The
+     * error is usually far below that bound, as the rounding errors
+     * of the taps are independent.
+     */
+    class CBMC_API my_pfb_clock_sync_mc : virtual public gr::block
+    {
+    public:
+      typedef boost::shared_ptr<my_pfb_clock_sync_mc> sptr;
+
+      /*!
+       * Build the multi-channel polyphase filterbank timing synchronizer.
+       * \param nchannels (int) The number of input and output streams.
+       * \param sps (double) The number of samples per symbol of all channels.
+       * \param loop_bw (float) The bandwidth of the control loops.
+       * \param filter_size (uint) The number of filters in the filterbank (default = 32).
+       * \param init_phase (float) The initial phase of every channel (default = 0).
+       * \param max_rate_deviation (float) Distance from 0 the rate can get (default = 1.5).
+       * \param rolloff (float) Excess bandwidth of the matched filter (default = 0.35).
+       * \param span (float) Matched filter length in symbols, 0 for 45 taps per arm
+       *                     (default = 0).
+       * \param window (int) filter::firdes::win_type of the matched filter,
+       *                     -1 for none (default = -1).
+       * \param format (sample_format) Input sample format (default = SAMPLES_FC32).
+       */
+      static sptr make(int nchannels, double sps, float loop_bw,
+		       unsigned int filter_size=32,
+		       float init_phase=0,
+		       float max_rate_deviation=1.5,
+		       float rolloff=0.35,
+		       float span=0,
+		       int window=-1,
+		       sample_format format=SAMPLES_FC32);
+
+      /*!
+       * \brief Set the samples per symbol of all channels
+       *
+       * Switches to the shared filterbank of sps quantized to 1/1000,
+       * designed unless it is one of the last eight in use, and resets
+       * the rate of every channel to the nominal one.
+       */
+      virtual void set_sps(double sps) = 0;
+
+      /*!
+       * \brief Set the bandwidth of all control loops
+       */
+      virtual void set_loop_bandwidth(float bw) = 0;
+
+      /*!
+       * \brief Set the maximum deviation from 0 the rate can have
+       */
+      virtual void set_max_rate_deviation(float m) = 0;
+
+      /*!
+       * \brief Sets all performance counters to 0
+       */
+      virtual void reset_counters() = 0;
+
+      /*!
+       * \brief Returns the number of channels
+       */
+      virtual int nchannels() const = 0;
+
+      /*!
+       * \brief Returns the loop bandwidth
+       */
+      virtual float loop_bandwidth() const = 0;
+
+      /*!
+       * \brief Returns the current error of the control loop of \p channel
+       */
+      virtual float error(int channel) const = 0;
+
+      /*!
+       * \brief Returns the current rate of the control loop of \p channel
+       */
+      virtual float rate(int channel) const = 0;
+
+      /*!
+       * \brief Returns the current phase arm of the control loop of \p channel
+       */
+      virtual float phase(int channel) const = 0;
+
+      /*!
+       * \brief Returns the number of symbols produced by all channels
+       */
+      virtual uint64_t symbols_produced() const = 0;
+
+      /*!
+       * \brief Returns the seconds spent in the loop
+       *
+       * Divided by symbols_produced() this is the time per symbol
+       * and channel.
+       */
+      virtual double work_time() const = 0;
+
+      /*!
+       * \brief Returns the number of calls that produced no symbol on
+       * any channel
+       *
+       * A high share of all calls means the block is starved by the
+       * blocks before it, not that it is slow.
+       */
+      virtual uint64_t zero_output_calls() const = 0;
+
+      /*!
+       * \brief Returns the number of sps changes applied
+       */
+      virtual uint64_t retunes() const = 0;
+
+      /*!
+       * \brief Returns the number of filterbanks designed
+       */
+      virtual uint64_t banks_designed() const = 0;
+
+      /*!
+       * \brief Returns the seconds spent designing filterbanks
+       */
+      virtual double design_time() const = 0;
+    };
+
+  } /* namespace cbmc */
+} /* namespace gr */
+
+#endif /* INCLUDED_CBMC_MY_PFB_CLOCK_SYNC_MC_H */
@@ -0,0 +1,169 @@
+/* -*- c++ -*- */
+/* 
+ * Copyright 2016 <+YOU OR YOUR COMPANY+>.
+ * 
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ * 
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+
+#ifndef INCLUDED_CBMC_RECEIVER_H
+#define INCLUDED_CBMC_RECEIVER_H
+
+#include <cbmc/api.h>
+#include <gnuradio/block.h>
+
+namespace gr {
+  namespace cbmc {
+
+    /*!
+     * \brief Frequency and sps estimation, timing recovery and
+     * modulation classification in one block
+     * \ingroup cbmc
+     *
+     * \details
+     * Does the work of the chain freq_sps_det -> my_pfb_clock_sync ->
+     * modulation_classifier without scheduler hops in between. Every
+     * \p decimation input samples are estimated and frequency
+     * corrected like in freq_sps_det, the estimated sps is handed
+     * straight to the maximum likelihood timing loop, and the symbols
+     * are classified in blocks of \p classifier_decimation like in
+     * modulation_classifier. The chunk stays in cache through all
+     * three stages, and no buffers or "det_sps" tags are passed
+     * between them.
+     *
+     * The output is the phase corrected symbols of modulation_classifier.
+     * The first symbol of each classified block is tagged with
+     * "det_mod" and "snr", as in the separate chain.
+     *
+     * Different from the chain, the timing loop is the one of
+     * my_pfb_clock_sync_mc: maximum likelihood detector, filterbank
+     * interpolation and one output per symbol. It has no lock detector,
+     * so there are no "clock_lock" tags, and it runs with the tracking
+     * gains from the first symbol instead of shifting down from wider
+     * acquisition gains. The sps estimate is followed on the 1/1000
+     * grid of the filterbank cache; an estimate that rounds to the
+     * bank in use leaves the loop alone, and returning to one of the
+     * last eight banks keeps the rate the loop tracks. A bank not in
+     * the cache is designed within the call, use the separate blocks
+     * where the sps is expected to change often.
+     */
+    class CBMC_API receiver : virtual public gr::block
+    {
+    public:
+      typedef boost::shared_ptr<receiver> sptr;
+
+      /*!
+       * Build the fused receiver.
+       * \param decimation (int) Samples per frequency and sps estimate.
+       * \param nsubdiv (int) Subdivisions of the refined frequency search, 1 for none.
+       * \param sps (double) The initial number of samples per symbol.
+       * \param loop_bw (float) The bandwidth of the timing loop.
+       * \param filter_size (uint) The number of filters in the filterbank (default = 32).
+       * \param init_phase (float) The initial filter phase (default = 0).
+       * \param max_rate_deviation (float) Distance from 0 the rate can get (default = 1.5).
+       * \param classifier_decimation (int) Symbols per classification (default = 500).
+       * \param rolloff (float) Excess bandwidth of the matched filter (default = 0.35).
+       * \param span (float) Matched filter length in symbols, 0 for 45 taps per arm
+       *                     (default = 0).
+       * \param window (int) filter::firdes::win_type of the matched filter,
+       *                     -1 for none (default = -1).
+       */
+      static sptr make(int decimation, int nsubdiv, double sps, float loop_bw,
+		       unsigned int filter_size=32,
+		       float init_phase=0,
+		       float max_rate_deviation=1.5,
+		       int classifier_decimation=500,
+		       float rolloff=0.35,
+		       float span=0,
+		       int window=-1);
+
+      /*!
+       * \brief Set the loop bandwidth of the timing loop
+       */
+      virtual void set_loop_bandwidth(float bw) = 0;
+
+      /*!
+       * \brief Sets all performance counters to 0
+       */
+      virtual void reset_counters() = 0;
+
+      /*!
+       * \brief Returns the loop bandwidth
+       */
+      virtual float loop_bandwidth() const = 0;
+
+      /*!
+       * \brief Returns the last frequency offset in cycles per sample
+       */
+      virtual float f_offset() const = 0;
+
+      /*!
+       * \brief Returns the samples per symbol of the timing loop, the
+       * last estimate that moved it to another bank
+       */
+      virtual float sps() const = 0;
+
+      /*!
+       * \brief Returns the last classification, indexed like
+       * modulation_classifier::get_stored_mod()
+       */
+      virtual unsigned int modulation() const = 0;
+
+      /*!
+       * \brief Returns the SNR in dB of the last classified block
+       */
+      virtual float snr() const = 0;
+
+      /*!
+       * \brief Returns the number of decimation blocks processed
+       */
+      virtual uint64_t blocks_processed() const = 0;
+
+      /*!
+       * \brief Returns the number of symbols produced
+       */
+      virtual uint64_t symbols_produced() const = 0;
+
+      /*!
+       * \brief Returns the seconds spent in the frequency and sps estimator
+       */
+      virtual double estimator_time() const = 0;
+
+      /*!
+       * \brief Returns the seconds spent in the timing loop
+       */
+      virtual double loop_time() const = 0;
+
+      /*!
+       * \brief Returns the seconds spent classifying
+       */
+      virtual double classifier_time() const = 0;
+
+      /*!
+       * \brief Returns the number of sps changes applied
+       */
+      virtual uint64_t retunes() const = 0;
+
+      /*!
+       * \brief Returns the number of "det_mod" and "snr" tags added
+       */
+      virtual uint64_t tags_emitted() const = 0;
+    };
+
+  } /* namespace cbmc */
+} /* namespace gr */
+
+#endif /* INCLUDED_CBMC_RECEIVER_H */
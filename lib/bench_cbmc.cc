@@ -0,0 +1,541 @@
+/* -*- c++ -*- */
+/* 
+ * Copyright 2016 <+YOU OR YOUR COMPANY+>.
+ * 
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ * 
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+
+/*
+ * Microbenchmarks of the cbmc DSP kernels, run outside of a flowgraph.
+ *
+ *   bench-cbmc [--json] [--min-time <seconds>] [<name filter>]
+ *
+ * Every benchmark reports the time per input sample it processes.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "freq_sps_det_impl.h"
+#include "modulation_classifier_impl.h"
+#include "my_pfb_clock_sync_impl.h"
+#include "rng.h"
+
+#include <gnuradio/block_detail.h>
+#include <gnuradio/buffer.h>
+#include <gnuradio/high_res_timer.h>
+#include <algorithm>
+#include <cmath>
+#include <complex>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <utility>
+#include <vector>
+
+using namespace gr::cbmc;
+
+namespace {
+
+  typedef std::vector< std::pair<std::string, double> > bench_params;
+
+  struct bench_result
+  {
+    std::string  name;
+    bench_params params;
+    double       ns_per_sample;
+    long         iterations;
+  };
+
+  double             g_min_time = 0.2;      // seconds per benchmark
+  std::string        g_filter;
+  std::vector<bench_result> g_results;
+  volatile float     g_sink;                // keeps results alive
+
+  // Repeats fn() in growing batches until g_min_time has passed, fn
+  // processes nsamples input samples per call
+  template<typename F>
+  void
+  run_bench(const std::string &name, const bench_params &params,
+	    int nsamples, F fn)
+  {
+    if(!g_filter.empty() && name.find(g_filter) == std::string::npos) {
+      return;
+    }
+
+    fn();   // warm up caches and lazy allocations
+
+    long iterations = 0;
+    long batch = 1;
+    double elapsed = 0;
+    gr::high_res_timer_type start = gr::high_res_timer_now();
+    while(elapsed < g_min_time) {
+      for(long k = 0; k < batch; k++) {
+	fn();
+      }
+      iterations += batch;
+      batch *= 2;
+      elapsed = (double)(gr::high_res_timer_now() - start) / gr::high_res_timer_tps();
+    }
+
+    bench_result r;
+    r.name = name;
+    r.params = params;
+    r.ns_per_sample = elapsed * 1e9 / ((double)iterations * nsamples);
+    r.iterations = iterations;
+    g_results.push_back(r);
+  }
+
+  // QPSK with rectangular pulses of sps samples, a frequency offset in
+  // cycles per sample and white noise
+  std::vector<gr_complex>
+  make_signal(int n, double sps, double f_offset, float noise = 0.05)
+  {
+    rng r(42);
+
+    std::vector<gr_complex> out(n);
+    gr_complex sym;
+    for(int i = 0; i < n; i++) {
+      if(i == 0 || (int)(i / sps) != (int)((i - 1) / sps)) {
+	sym = gr_complex(r.integer(2) ? 0.707f : -0.707f, r.integer(2) ? 0.707f : -0.707f);
+      }
+      double ph = 2 * M_PI * f_offset * i;
+      out[i] = sym * gr_complex(cos(ph), sin(ph))
+	+ gr_complex(noise * r.gauss(), noise * r.gauss());
+    }
+    return out;
+  }
+
+  /*
+   * The benchmarked calls, one function object each: run_bench() is a
+   * template on it, so the call is inlined like the work loop does.
+   */
+  struct calc_f_offset_and_sps_fn
+  {
+    freq_sps_det_impl *det;
+    const gr_complex  *in;
+
+    void operator()()
+    {
+      float f_offset, sps;
+      det->calc_f_offset_and_sps(f_offset, sps, in);
+      g_sink = f_offset + sps;
+    }
+  };
+
+  struct ft_refinement_fn
+  {
+    freq_sps_det_impl *det;
+    const gr_complex  *in;
+    int                decim;
+    int                nsubdiv;
+
+    void operator()()
+    {
+      g_sink = det->ft_refinement(decim / 100, in, nsubdiv);
+    }
+  };
+
+  struct f_shift_samples_fn
+  {
+    freq_sps_det_impl *det;
+    gr_complex        *out;
+    const gr_complex  *in;
+    int                decim;
+
+    void operator()()
+    {
+      det->f_shift_samples(out, in, 0.01);
+      g_sink = out[decim-1].real();
+    }
+  };
+
+  struct cumulant_2_1_fn
+  {
+    modulation_classifier_impl *mc;
+    const gr_complex           *in;
+
+    void operator()()
+    {
+      g_sink = mc->computeCumulant_2_1(in).real();
+    }
+  };
+
+  struct cumulant_4_fn
+  {
+    modulation_classifier_impl *mc;
+    const gr_complex           *in;
+    gr_complex                  c_2_1;
+
+    void operator()()
+    {
+      gr_complex c_4_0, c_4_2, m_4_2;
+      mc->computeCumulant_4_0_u_4_2(c_4_0, c_4_2, m_4_2, in, c_2_1);
+      g_sink = c_4_0.real() + c_4_2.real();
+    }
+  };
+
+  struct det_mod2_fn
+  {
+    modulation_classifier_impl *mc;
+    gr_complex                 *shifted;
+    const gr_complex           *in;
+
+    void operator()()
+    {
+      float snr;
+      g_sink = mc->detMod2(shifted, snr, in);
+    }
+  };
+
+  // The filterbank calls step through the arms like the loop does
+  struct filter_fused_fn
+  {
+    const filter_bank *bank;
+    const gr_complex  *in;
+    int                arm;
+
+    void operator()()
+    {
+      gr_complex out, dout;
+      bank->filter_fused(arm, in, out, dout);
+      arm = (arm + 7) & (bank->nfilters - 1);
+      g_sink = out.real() + dout.real();
+    }
+  };
+
+  struct filter_fn
+  {
+    const filter_bank *bank;
+    const gr_complex  *in;
+    int                arm;
+
+    void operator()()
+    {
+      gr_complex out = bank->filter(arm, in);
+      arm = (arm + 7) & (bank->nfilters - 1);
+      g_sink = out.real();
+    }
+  };
+
+  struct filter_fused_q15_fn
+  {
+    const filter_bank *bank;
+    const short       *in;
+    int                arm;
+
+    void operator()()
+    {
+      gr_complex out, dout;
+      bank->filter_fused_q15(arm, in, out, dout);
+      arm = (arm + 7) & (bank->nfilters - 1);
+      g_sink = out.real() + dout.real();
+    }
+  };
+
+  struct interpolate_fn
+  {
+    const filter_bank *bank;
+    const gr_complex  *in;
+    float              mu;
+
+    void operator()()
+    {
+      gr_complex out, dout;
+      bank->interpolate(in, mu, out, dout);
+      mu = (mu < 0.9f) ? mu + 0.13f : 0;
+      g_sink = out.real() + dout.real();
+    }
+  };
+
+  // One call of the symbol loop on the same prefilled input, the loop
+  // state carries over from call to call like between scheduler calls
+  struct general_work_fn
+  {
+    gr::block                 *blk;
+    int                        noutput;
+    gr_vector_int              ninput;
+    gr_vector_const_void_star  in;
+    gr_vector_void_star        out;
+
+    void operator()()
+    {
+      int n = blk->general_work(noutput, ninput, in, out);
+      g_sink = ((gr_complex *)out[0])[std::max(n - 1, 0)].real();
+    }
+  };
+
+  void
+  bench_freq_sps_det()
+  {
+    const int decimations[] = {256, 1024, 4096};
+    const int nsubdivs[] = {1, 4, 16};
+
+    for(int d = 0; d < 3; d++) {
+      int decim = decimations[d];
+      std::vector<gr_complex> in = make_signal(decim, 4, 0.01);
+      std::vector<gr_complex> out(decim);
+
+      for(int s = 0; s < 3; s++) {
+	int nsubdiv = nsubdivs[s];
+	boost::shared_ptr<freq_sps_det_impl> det =
+	  gnuradio::get_initial_sptr(new freq_sps_det_impl(decim, nsubdiv, 0));
+
+	bench_params p;
+	p.push_back(std::make_pair("decimation", (double)decim));
+	p.push_back(std::make_pair("nsubdiv", (double)nsubdiv));
+
+	calc_f_offset_and_sps_fn calc = {det.get(), &in[0]};
+	run_bench("freq_sps_det.calc_f_offset_and_sps", p, decim, calc);
+
+	if(nsubdiv > 1) {
+	  ft_refinement_fn refine = {det.get(), &in[0], decim, nsubdiv};
+	  run_bench("freq_sps_det.ft_refinement", p, decim, refine);
+	}
+      }
+
+      boost::shared_ptr<freq_sps_det_impl> det =
+	gnuradio::get_initial_sptr(new freq_sps_det_impl(decim, 1, 0));
+      bench_params p;
+      p.push_back(std::make_pair("decimation", (double)decim));
+      f_shift_samples_fn shift = {det.get(), &out[0], &in[0], decim};
+      run_bench("freq_sps_det.f_shift_samples", p, decim, shift);
+    }
+  }
+
+  void
+  bench_modulation_classifier()
+  {
+    const int decimations[] = {256, 1024, 4096};
+
+    for(int d = 0; d < 3; d++) {
+      int decim = decimations[d];
+      std::vector<gr_complex> in = make_signal(decim, 1, 0);
+      std::vector<gr_complex> shifted(decim);
+      boost::shared_ptr<modulation_classifier_impl> mc =
+	gnuradio::get_initial_sptr(new modulation_classifier_impl(decim, false, 0));
+
+      bench_params p;
+      p.push_back(std::make_pair("decimation", (double)decim));
+
+      cumulant_2_1_fn c21 = {mc.get(), &in[0]};
+      run_bench("modulation_classifier.computeCumulant_2_1", p, decim, c21);
+
+      cumulant_4_fn c4 = {mc.get(), &in[0], mc->computeCumulant_2_1(&in[0])};
+      run_bench("modulation_classifier.computeCumulant_4_0_u_4_2", p, decim, c4);
+
+      det_mod2_fn det = {mc.get(), &shifted[0], &in[0]};
+      run_bench("modulation_classifier.detMod2", p, decim, det);
+    }
+  }
+
+  // The filtering of one symbol in the inner loop of
+  // my_pfb_clock_sync::general_work, per input sample of the symbol
+  void
+  bench_clock_sync()
+  {
+    const double spss[] = {2, 4, 8};
+    const float spans[] = {0, 8};
+    const int nfilters = 32;
+
+    for(int s = 0; s < 3; s++) {
+      double sps = spss[s];
+      for(int m = 0; m < 2; m++) {
+	rrc_params rrc;
+	rrc.rolloff = 0.35;
+	rrc.span = spans[m];
+	rrc.window = spans[m] > 0 ? 0 : -1;
+
+	filter_bank_sptr bank = filter_bank::make_pfb(nfilters, rrc.prototype(nfilters, sps));
+	bank->quantize();
+	int ntaps = bank->taps_per_filter;
+
+	std::vector<gr_complex> in = make_signal(ntaps + 8, sps, 0);
+	std::vector<short> qin(2 * in.size());
+	for(unsigned int i = 0; i < in.size(); i++) {
+	  qin[2*i] = (short)lrintf(in[i].real() * 16384);
+	  qin[2*i+1] = (short)lrintf(in[i].imag() * 16384);
+	}
+
+	bench_params p;
+	p.push_back(std::make_pair("sps", sps));
+	p.push_back(std::make_pair("span", (double)spans[m]));
+	p.push_back(std::make_pair("taps_per_filter", (double)ntaps));
+
+	filter_fused_fn fused = {bank.get(), &in[0], 0};
+	run_bench("my_pfb_clock_sync.filter_fused", p, (int)sps, fused);
+
+	filter_fn filter = {bank.get(), &in[0], 0};
+	run_bench("my_pfb_clock_sync.filter", p, (int)sps, filter);
+
+	filter_fused_q15_fn fused_q15 = {bank.get(), &qin[0], 0};
+	run_bench("my_pfb_clock_sync.filter_fused_q15", p, (int)sps, fused_q15);
+
+	// INTERP_CUBIC filters at the input rate with a single arm
+	std::vector<float> taps = rrc.prototype(1, sps);
+	filter_bank cubic(1, taps.size());
+	cubic.set_arm(0, taps, std::vector<float>(taps.size(), 0));
+	std::vector<gr_complex> cin = make_signal(taps.size() + 8, sps, 0);
+	interpolate_fn interp = {&cubic, &cin[0], 0};
+	run_bench("my_pfb_clock_sync.interpolate", p, (int)sps, interp);
+      }
+    }
+  }
+
+  // Gives a block the buffers a flowgraph would, general_work then
+  // consumes, reads tags and tags its output without a scheduler
+  void
+  attach_buffers(gr::block_sptr blk, int nitems)
+  {
+    gr::block_detail_sptr detail = gr::make_block_detail(1, 1);
+    gr::buffer_sptr in = gr::make_buffer(nitems, sizeof(gr_complex), blk);
+    detail->set_input(0, gr::buffer_add_reader(in, blk->history() - 1, blk));
+    detail->set_output(0, gr::make_buffer(nitems, sizeof(gr_complex), blk));
+    blk->set_detail(detail);
+  }
+
+  // my_pfb_clock_sync::general_work over nsymbols symbols, per input
+  // sample, for every interpolator, timing error detector and osps
+  void
+  bench_clock_sync_work()
+  {
+    const double spss[] = {2, 4};
+    const interp_type interps[] = {INTERP_PFB, INTERP_CUBIC};
+    const ted_type teds[] = {TED_ML, TED_GARDNER, TED_MUELLER_MULLER};
+    const char *interp_names[] = {"pfb", "cubic"};
+    const char *ted_names[] = {"ml", "gardner", "mm"};
+    const int nsymbols = 1024;
+
+    for(int s = 0; s < 2; s++) {
+      double sps = spss[s];
+      for(int m = 0; m < 2; m++) {
+	for(int t = 0; t < 3; t++) {
+	  for(int osps = 1; osps <= 2; osps++) {
+	    boost::shared_ptr<my_pfb_clock_sync_impl> sync =
+	      gnuradio::get_initial_sptr
+	      (new my_pfb_clock_sync_impl(sps, 2*M_PI/100, 32, 0, 1.5, osps,
+					  10000, interps[m], teds[t]));
+
+	    // Enough input that the output, not the input, ends the call
+	    int ninput = sync->history() - 1 + (int)((nsymbols + 8) * sps) + sync->history();
+	    std::vector<gr_complex> in = make_signal(ninput, sps, 0);
+	    std::vector<gr_complex> out(nsymbols * osps);
+	    attach_buffers(sync, std::max(ninput, (int)out.size()));
+
+	    bench_params p;
+	    p.push_back(std::make_pair("sps", sps));
+	    p.push_back(std::make_pair("osps", (double)osps));
+
+	    general_work_fn work;
+	    work.blk = sync.get();
+	    work.noutput = out.size();
+	    work.ninput.push_back(ninput);
+	    work.in.push_back(&in[0]);
+	    work.out.push_back(&out[0]);
+	    run_bench(std::string("my_pfb_clock_sync.general_work.") + interp_names[m]
+		      + "." + ted_names[t], p, (int)(nsymbols * sps), work);
+	  }
+	}
+      }
+    }
+  }
+
+  std::string
+  json_escape(const std::string &s)
+  {
+    std::string out;
+    for(unsigned int i = 0; i < s.size(); i++) {
+      if(s[i] == '"' || s[i] == '\\') {
+	out += '\\';
+      }
+      out += s[i];
+    }
+    return out;
+  }
+
+  void
+  print_json()
+  {
+    printf("{\n  \"benchmarks\": [\n");
+    for(unsigned int i = 0; i < g_results.size(); i++) {
+      const bench_result &r = g_results[i];
+      printf("    {\"name\": \"%s\", \"params\": {", json_escape(r.name).c_str());
+      for(unsigned int j = 0; j < r.params.size(); j++) {
+	printf("%s\"%s\": %g", j ? ", " : "",
+	       json_escape(r.params[j].first).c_str(), r.params[j].second);
+      }
+      printf("}, \"ns_per_sample\": %.4f, \"iterations\": %ld}%s\n",
+	     r.ns_per_sample, r.iterations, (i + 1 < g_results.size()) ? "," : "");
+    }
+    printf("  ]\n}\n");
+  }
+
+  void
+  print_table()
+  {
+    for(unsigned int i = 0; i < g_results.size(); i++) {
+      const bench_result &r = g_results[i];
+      std::string params;
+      for(unsigned int j = 0; j < r.params.size(); j++) {
+	char buf[64];
+	snprintf(buf, sizeof(buf), "%s%s=%g", j ? " " : "",
+		 r.params[j].first.c_str(), r.params[j].second);
+	params += buf;
+      }
+      printf("%-48s %-44s %10.3f ns/sample\n",
+	     r.name.c_str(), params.c_str(), r.ns_per_sample);
+    }
+  }
+
+} // namespace
+
+int
+main(int argc, char **argv)
+{
+  bool json = false;
+  for(int i = 1; i < argc; i++) {
+    if(!strcmp(argv[i], "--json")) {
+      json = true;
+    }
+    else if(!strcmp(argv[i], "--min-time") && i + 1 < argc) {
+      g_min_time = atof(argv[++i]);
+    }
+    else if(argv[i][0] == '-') {
+      fprintf(stderr, "usage: %s [--json] [--min-time <seconds>] [<name filter>]\n", argv[0]);
+      return 1;
+    }
+    else {
+      g_filter = argv[i];
+    }
+  }
+
+  bench_freq_sps_det();
+  bench_modulation_classifier();
+  bench_clock_sync();
+  bench_clock_sync_work();
+
+  if(json) {
+    print_json();
+  }
+  else {
+    print_table();
+  }
+
+  return 0;
+}
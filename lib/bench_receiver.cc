@@ -0,0 +1,425 @@
+/* -*- c++ -*- */
+/* 
+ * Copyright 2016 <+YOU OR YOUR COMPANY+>.
+ * 
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ * 
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+
+/*
+ * Headless throughput and latency benchmark of the receiver chain
+ *
+ *   source -> channel model -> freq_sps_det -> my_pfb_clock_sync
+ *          -> modulation_classifier -> null sink
+ *
+ *   bench-receiver [--mod bpsk,qpsk,8psk,16qam] [--sps 4,8]
+ *                  [--decim 1000,10000] [--nsubdiv 2] [--classifier-decim 500]
+ *                  [--nsamples 20000000] [--noise 0.1] [--json]
+ *
+ * Every combination of modulation, sps and freq_sps_det decimation is
+ * run as fast as possible. Reported are the sustained input rate, the
+ * share of the work time of each block (from the GNU Radio performance
+ * counters, if they are built in) and percentiles of the time a sample
+ * takes from the source to the sink. The source runs flat out, so the
+ * latency includes the buffers filled up to the slowest block.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <cbmc/freq_sps_det.h>
+#include <cbmc/my_pfb_clock_sync.h>
+#include <cbmc/modulation_classifier.h>
+#include "rng.h"
+
+#include <gnuradio/top_block.h>
+#include <gnuradio/high_res_timer.h>
+#include <gnuradio/sync_block.h>
+#include <gnuradio/io_signature.h>
+#include <gnuradio/prefs.h>
+#include <gnuradio/blocks/vector_source_c.h>
+#include <gnuradio/blocks/head.h>
+#include <gnuradio/blocks/null_sink.h>
+#include <gnuradio/channels/channel_model.h>
+#include <gnuradio/filter/firdes.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace {
+
+  const gr::high_res_timer_type g_start = gr::high_res_timer_now();
+
+  // Monotonic time since start up
+  uint64_t
+  now_ns()
+  {
+    gr::high_res_timer_type ticks = gr::high_res_timer_now() - g_start;
+    return (uint64_t)(ticks * (1e9 / gr::high_res_timer_tps()));
+  }
+
+  /*
+   * Pass-through block that tags every interval-th sample with the
+   * time it passes.
+   */
+  class latency_stamp : public gr::sync_block
+  {
+  public:
+    typedef boost::shared_ptr<latency_stamp> sptr;
+
+    static sptr make(int interval)
+    {
+      return gnuradio::get_initial_sptr(new latency_stamp(interval));
+    }
+
+    latency_stamp(int interval)
+      : gr::sync_block("latency_stamp",
+		       gr::io_signature::make(1, 1, sizeof(gr_complex)),
+		       gr::io_signature::make(1, 1, sizeof(gr_complex))),
+	d_interval(interval), d_next(0)
+    {
+    }
+
+    int work(int noutput_items,
+	     gr_vector_const_void_star &input_items,
+	     gr_vector_void_star &output_items)
+    {
+      memcpy(output_items[0], input_items[0], noutput_items*sizeof(gr_complex));
+
+      uint64_t end = nitems_written(0) + noutput_items;
+      if(d_next < end) {
+	pmt::pmt_t t = pmt::from_uint64(now_ns());
+	for(; d_next < end; d_next += d_interval) {
+	  add_item_tag(0, d_next, pmt::mp("bench_t0"), t);
+	}
+      }
+      return noutput_items;
+    }
+
+  private:
+    uint64_t d_interval;
+    uint64_t d_next;
+  };
+
+  /*
+   * Sink recording the age of every time tag that reaches it.
+   */
+  class latency_sink : public gr::sync_block
+  {
+  public:
+    typedef boost::shared_ptr<latency_sink> sptr;
+
+    static sptr make()
+    {
+      return gnuradio::get_initial_sptr(new latency_sink());
+    }
+
+    latency_sink()
+      : gr::sync_block("latency_sink",
+		       gr::io_signature::make(1, 1, sizeof(gr_complex)),
+		       gr::io_signature::make(0, 0, 0))
+    {
+    }
+
+    int work(int noutput_items,
+	     gr_vector_const_void_star &input_items,
+	     gr_vector_void_star &output_items)
+    {
+      std::vector<gr::tag_t> tags;
+      get_tags_in_range(tags, 0, nitems_read(0), nitems_read(0) + noutput_items,
+			pmt::mp("bench_t0"));
+      if(!tags.empty()) {
+	uint64_t now = now_ns();
+	for(unsigned int i = 0; i < tags.size(); i++) {
+	  d_latency.push_back((now - pmt::to_uint64(tags[i].value)) * 1e-9);
+	}
+      }
+      return noutput_items;
+    }
+
+    std::vector<double> d_latency;   // seconds
+  };
+
+  struct bench_config
+  {
+    std::string mod;
+    int         sps;
+    int         decim;
+    int         nsubdiv;
+    int         cls_decim;
+    long        nsamples;
+    float       noise;
+  };
+
+  struct bench_result
+  {
+    bench_config cfg;
+    double       samples_per_sec;
+    std::vector< std::pair<std::string, double> > cpu_share;
+    double       lat_p50, lat_p90, lat_p99, lat_max;
+  };
+
+  std::vector<gr_complex>
+  constellation(const std::string &mod)
+  {
+    std::vector<gr_complex> c;
+    if(mod == "bpsk") {
+      c.push_back(1);
+      c.push_back(-1);
+    }
+    else if(mod == "qpsk" || mod == "8psk") {
+      int m = (mod == "qpsk") ? 4 : 8;
+      for(int i = 0; i < m; i++) {
+	c.push_back(std::polar(1.0f, (float)(2*M_PI*i/m + M_PI/m)));
+      }
+    }
+    else if(mod == "16qam") {
+      for(int i = -3; i <= 3; i += 2) {
+	for(int q = -3; q <= 3; q += 2) {
+	  c.push_back(gr_complex(i, q) / sqrtf(10));
+	}
+      }
+    }
+    else {
+      fprintf(stderr, "unknown modulation %s\n", mod.c_str());
+      exit(1);
+    }
+    return c;
+  }
+
+  // Random symbols shaped with a root raised cosine, looped by the source
+  std::vector<gr_complex>
+  make_baseband(const std::string &mod, int sps, int nsymbols)
+  {
+    std::vector<gr_complex> c = constellation(mod);
+    std::vector<float> rrc = gr::filter::firdes::root_raised_cosine(sps, sps, 1.0, 0.35, 11*sps);
+
+    gr::cbmc::rng r(1);
+    std::vector<gr_complex> syms(nsymbols);
+    for(int i = 0; i < nsymbols; i++) {
+      syms[i] = c[r.integer(c.size())];
+    }
+
+    // Circular convolution, so the looped signal has no seam
+    int n = nsymbols * sps;
+    std::vector<gr_complex> out(n);
+    for(int i = 0; i < nsymbols; i++) {
+      for(unsigned int k = 0; k < rrc.size(); k++) {
+	out[(i*sps + k) % n] += syms[i] * rrc[k];
+      }
+    }
+    return out;
+  }
+
+  double
+  percentile(std::vector<double> &v, double p)
+  {
+    if(v.empty()) {
+      return 0;
+    }
+    size_t k = std::min(v.size() - 1, (size_t)(p * v.size()));
+    std::nth_element(v.begin(), v.begin() + k, v.end());
+    return v[k];
+  }
+
+  bench_result
+  run(const bench_config &cfg)
+  {
+    gr::top_block_sptr tb = gr::make_top_block("bench_receiver");
+
+    std::vector<gr_complex> bb = make_baseband(cfg.mod, cfg.sps, 4096);
+    gr::blocks::vector_source_c::sptr src = gr::blocks::vector_source_c::make(bb, true);
+    gr::blocks::head::sptr head = gr::blocks::head::make(sizeof(gr_complex), cfg.nsamples);
+    latency_stamp::sptr stamp = latency_stamp::make(cfg.decim);
+    gr::channels::channel_model::sptr chan =
+      gr::channels::channel_model::make(cfg.noise, 0.001, 1.0, std::vector<gr_complex>(1, 1), 0);
+    gr::cbmc::freq_sps_det::sptr det = gr::cbmc::freq_sps_det::make(cfg.decim, cfg.nsubdiv);
+    gr::cbmc::my_pfb_clock_sync::sptr sync =
+      gr::cbmc::my_pfb_clock_sync::make(cfg.sps, 6.28/100.0, 32, 16, 1.5, 1, cfg.decim);
+    gr::cbmc::modulation_classifier::sptr cls = gr::cbmc::modulation_classifier::make(cfg.cls_decim, false);
+    latency_sink::sptr sink = latency_sink::make();
+
+    tb->connect(src, 0, head, 0);
+    tb->connect(head, 0, stamp, 0);
+    tb->connect(stamp, 0, chan, 0);
+    tb->connect(chan, 0, det, 0);
+    tb->connect(det, 0, sync, 0);
+    tb->connect(sync, 0, cls, 0);
+    tb->connect(cls, 0, sink, 0);
+
+    uint64_t start = now_ns();
+    tb->run();
+    double elapsed = (now_ns() - start) * 1e-9;
+
+    bench_result r;
+    r.cfg = cfg;
+    r.samples_per_sec = cfg.nsamples / elapsed;
+
+    // Work time of each block, 0 without performance counters
+    std::vector< std::pair<std::string, gr::block_sptr> > blocks;
+    blocks.push_back(std::make_pair("source", gr::block_sptr(src)));
+    blocks.push_back(std::make_pair("freq_sps_det", gr::block_sptr(det)));
+    blocks.push_back(std::make_pair("my_pfb_clock_sync", gr::block_sptr(sync)));
+    blocks.push_back(std::make_pair("modulation_classifier", gr::block_sptr(cls)));
+    double total = 0;
+    std::vector<double> times;
+    for(unsigned int i = 0; i < blocks.size(); i++) {
+      times.push_back(blocks[i].second->pc_work_time_total());
+      total += times.back();
+    }
+    for(unsigned int i = 0; i < blocks.size(); i++) {
+      r.cpu_share.push_back(std::make_pair(blocks[i].first, total > 0 ? times[i] / total : 0));
+    }
+
+    r.lat_p50 = percentile(sink->d_latency, 0.50);
+    r.lat_p90 = percentile(sink->d_latency, 0.90);
+    r.lat_p99 = percentile(sink->d_latency, 0.99);
+    r.lat_max = sink->d_latency.empty() ? 0 :
+      *std::max_element(sink->d_latency.begin(), sink->d_latency.end());
+    return r;
+  }
+
+  std::vector<std::string>
+  split(const std::string &s)
+  {
+    std::vector<std::string> out;
+    std::stringstream ss(s);
+    std::string item;
+    while(std::getline(ss, item, ',')) {
+      out.push_back(item);
+    }
+    return out;
+  }
+
+  void
+  print_json(const std::vector<bench_result> &results)
+  {
+    printf("{\n  \"runs\": [\n");
+    for(unsigned int i = 0; i < results.size(); i++) {
+      const bench_result &r = results[i];
+      printf("    {\"mod\": \"%s\", \"sps\": %d, \"decimation\": %d, \"nsubdiv\": %d, "
+	     "\"classifier_decimation\": %d, \"nsamples\": %ld,\n",
+	     r.cfg.mod.c_str(), r.cfg.sps, r.cfg.decim, r.cfg.nsubdiv,
+	     r.cfg.cls_decim, r.cfg.nsamples);
+      printf("     \"samples_per_sec\": %.1f, \"cpu_share\": {", r.samples_per_sec);
+      for(unsigned int j = 0; j < r.cpu_share.size(); j++) {
+	printf("%s\"%s\": %.4f", j ? ", " : "", r.cpu_share[j].first.c_str(), r.cpu_share[j].second);
+      }
+      printf("},\n     \"latency_s\": {\"p50\": %.6f, \"p90\": %.6f, \"p99\": %.6f, \"max\": %.6f}}%s\n",
+	     r.lat_p50, r.lat_p90, r.lat_p99, r.lat_max,
+	     (i + 1 < results.size()) ? "," : "");
+    }
+    printf("  ]\n}\n");
+  }
+
+  void
+  print_table(const std::vector<bench_result> &results)
+  {
+    for(unsigned int i = 0; i < results.size(); i++) {
+      const bench_result &r = results[i];
+      printf("%-6s sps=%-3d decim=%-6d %8.3f Msps  latency p50/p90/p99/max %.2f/%.2f/%.2f/%.2f ms\n",
+	     r.cfg.mod.c_str(), r.cfg.sps, r.cfg.decim, r.samples_per_sec * 1e-6,
+	     r.lat_p50 * 1e3, r.lat_p90 * 1e3, r.lat_p99 * 1e3, r.lat_max * 1e3);
+      printf("      ");
+      for(unsigned int j = 0; j < r.cpu_share.size(); j++) {
+	printf(" %s %.1f%%", r.cpu_share[j].first.c_str(), 100 * r.cpu_share[j].second);
+      }
+      printf("\n");
+    }
+  }
+
+} // namespace
+
+int
+main(int argc, char **argv)
+{
+  std::vector<std::string> mods = split("bpsk,qpsk,8psk,16qam");
+  std::vector<std::string> spss = split("4,8");
+  std::vector<std::string> decims = split("10000");
+  bench_config base;
+  base.nsubdiv = 2;
+  base.cls_decim = 500;
+  base.nsamples = 20000000;
+  base.noise = 0.1;
+  bool json = false;
+
+  for(int i = 1; i < argc; i++) {
+    std::string a = argv[i];
+    bool has_value = i + 1 < argc;
+    if(a == "--json") {
+      json = true;
+    }
+    else if(a == "--mod" && has_value) {
+      mods = split(argv[++i]);
+    }
+    else if(a == "--sps" && has_value) {
+      spss = split(argv[++i]);
+    }
+    else if(a == "--decim" && has_value) {
+      decims = split(argv[++i]);
+    }
+    else if(a == "--nsubdiv" && has_value) {
+      base.nsubdiv = atoi(argv[++i]);
+    }
+    else if(a == "--classifier-decim" && has_value) {
+      base.cls_decim = atoi(argv[++i]);
+    }
+    else if(a == "--nsamples" && has_value) {
+      base.nsamples = atol(argv[++i]);
+    }
+    else if(a == "--noise" && has_value) {
+      base.noise = atof(argv[++i]);
+    }
+    else {
+      fprintf(stderr, "usage: %s [--mod bpsk,qpsk,8psk,16qam] [--sps 4,8] [--decim 10000]\n"
+	      "       [--nsubdiv 2] [--classifier-decim 500] [--nsamples N] [--noise V] [--json]\n",
+	      argv[0]);
+      return 1;
+    }
+  }
+
+  // Per block work times, if GNU Radio was built with them
+  gr::prefs::singleton()->set_bool("PerfCounters", "on", true);
+
+  std::vector<bench_result> results;
+  for(unsigned int m = 0; m < mods.size(); m++) {
+    for(unsigned int s = 0; s < spss.size(); s++) {
+      for(unsigned int d = 0; d < decims.size(); d++) {
+	bench_config cfg = base;
+	cfg.mod = mods[m];
+	cfg.sps = atoi(spss[s].c_str());
+	cfg.decim = atoi(decims[d].c_str());
+	results.push_back(run(cfg));
+	if(!json) {
+	  print_table(std::vector<bench_result>(1, results.back()));
+	}
+      }
+    }
+  }
+
+  if(json) {
+    print_json(results);
+  }
+
+  return 0;
+}
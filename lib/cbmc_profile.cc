@@ -0,0 +1,170 @@
+/* -*- c++ -*- */
+/* 
+ * Copyright 2016 <+YOU OR YOUR COMPANY+>.
+ * 
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ * 
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/*
+ * Picks the fastest implementation of each arithmetic kernel on this
+ * machine and writes it to the kernel config, like volk_profile.
+ *
+ *   cbmc-profile [--dry-run] [--path <file>] [--nsamples <n>]
+ *
+ * Blocks read the config the first time they use a kernel.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "kernels.h"
+
+#include <gnuradio/high_res_timer.h>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <sys/stat.h>
+#include <vector>
+
+using namespace gr::cbmc;
+
+namespace {
+
+  volatile float g_sink;   // keeps results alive
+
+  // Best of 5 runs of at least 20 ms, in ns per sample
+  double
+  time_kernel(const std::string &kernel, const std::vector<gr_complex> &a,
+	      const std::vector<gr_complex> &b, std::vector<gr_complex> &out)
+  {
+    const int n = a.size();
+
+    double best = 1e30;
+    for(int run = 0; run < 5; run++) {
+      long iterations = 0;
+      double elapsed = 0;
+      gr::high_res_timer_type start = gr::high_res_timer_now();
+      while(elapsed < 0.02) {
+	for(int r = 2; r <= 8; r *= 2) {
+	  if(kernel == "power") {
+	    kernels::power(&out[0], &a[0], r, n);
+	    g_sink = out[n-1].real();
+	  }
+	  else if(kernel == "power_sum") {
+	    g_sink = kernels::power_sum(&a[0], r, n).real();
+	  }
+	  else if(kernel == "sum") {
+	    g_sink = kernels::sum(&a[0], n).real();
+	  }
+	  else if(kernel == "dot") {
+	    g_sink = kernels::dot(&a[0], &b[0], n).real();
+	  }
+	  else if(kernel == "dot_conj") {
+	    g_sink = kernels::dot_conj(&a[0], &b[0], n).real();
+	  }
+	}
+	iterations++;
+	elapsed = (double)(gr::high_res_timer_now() - start) / gr::high_res_timer_tps();
+      }
+      best = std::min(best, elapsed * 1e9 / ((double)iterations * 3 * n));
+    }
+    return best;
+  }
+
+  void
+  usage(const char *prog)
+  {
+    fprintf(stderr, "usage: %s [--dry-run] [--path <file>] [--nsamples <n>]\n", prog);
+    exit(1);
+  }
+
+} // anonymous namespace
+
+int
+main(int argc, char **argv)
+{
+  bool dry_run = false;
+  std::string path = kernels::kernel_config();
+  int nsamples = 4096;
+
+  for(int i = 1; i < argc; i++) {
+    if(!strcmp(argv[i], "--dry-run")) {
+      dry_run = true;
+    }
+    else if(!strcmp(argv[i], "--path") && i + 1 < argc) {
+      path = argv[++i];
+    }
+    else if(!strcmp(argv[i], "--nsamples") && i + 1 < argc) {
+      nsamples = atoi(argv[++i]);
+    }
+    else {
+      usage(argv[0]);
+    }
+  }
+  if(nsamples < 1) {
+    usage(argv[0]);
+  }
+
+  std::vector<gr_complex> a(nsamples), b(nsamples), out(nsamples);
+  for(int i = 0; i < nsamples; i++) {
+    a[i] = std::polar(1.0f, 0.1f * i);
+    b[i] = std::polar(0.5f, -0.3f * i);
+  }
+
+  std::vector<std::string> names = kernels::kernel_names();
+  std::vector<std::string> archs = kernels::arch_names();
+  std::vector<std::string> best(names.size());
+
+  for(unsigned int k = 0; k < names.size(); k++) {
+    double best_ns = 1e30;
+    for(unsigned int j = 0; j < archs.size(); j++) {
+      kernels::select(names[k], archs[j]);
+      double ns = time_kernel(names[k], a, b, out);
+      printf("%-10s %-8s %8.3f ns/sample\n", names[k].c_str(), archs[j].c_str(), ns);
+      if(ns < best_ns) {
+	best_ns = ns;
+	best[k] = archs[j];
+      }
+    }
+    printf("%-10s best: %s\n", names[k].c_str(), best[k].c_str());
+  }
+
+  if(dry_run) {
+    return 0;
+  }
+
+  // Create the directory of the default path
+  std::string::size_type slash = path.rfind('/');
+  if(slash != std::string::npos && slash > 0) {
+    mkdir(path.substr(0, slash).c_str(), 0755);
+  }
+
+  std::ofstream config(path.c_str());
+  if(!config) {
+    fprintf(stderr, "cannot write %s\n", path.c_str());
+    return 1;
+  }
+  config << "# cbmc kernel config, written by cbmc-profile\n";
+  for(unsigned int k = 0; k < names.size(); k++) {
+    config << names[k] << " " << best[k] << "\n";
+  }
+  printf("Writing %s\n", path.c_str());
+  return 0;
+}
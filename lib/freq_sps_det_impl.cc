@@ -24,6 +24,7 @@
 
 #include <gnuradio/io_signature.h>
 #include "freq_sps_det_impl.h"
+#include "kernels.h"
 #include <volk/volk.h>
 #include <complex>
 
@@ -31,22 +32,24 @@ namespace gr {
   namespace cbmc {
 
     freq_sps_det::sptr
-    freq_sps_det::make(int decimation, int fft_size)
+    freq_sps_det::make(int decimation, int fft_size, size_t probe_capacity)
     {
       return gnuradio::get_initial_sptr
-        (new freq_sps_det_impl(decimation, fft_size));
+        (new freq_sps_det_impl(decimation, fft_size, probe_capacity));
     }
 
-    freq_sps_det_impl::freq_sps_det_impl(int decimation, int fft_size)
+    freq_sps_det_impl::freq_sps_det_impl(int decimation, int fft_size, size_t probe_capacity)
       : gr::sync_block("freq_sps_det",
               gr::io_signature::make(1, 1, sizeof(gr_complex)),
               gr::io_signature::make(1, 1, sizeof(gr_complex))),
-    d_decimation(decimation), d_nsubdiv(fft_size)
+    d_decimation(decimation), d_nsubdiv(fft_size), d_stored_freqs(probe_capacity)
     {
     d_fft_size = d_decimation;
     d_fft = new fft::fft_complex(d_fft_size, true, 1);
     d_goertzel = new fft::goertzel(1, d_fft_size, 0);
     set_output_multiple(d_decimation);
+
+    d_ws.reserve(workspace_size(d_nsubdiv));
     }
 
     /*
@@ -65,6 +68,8 @@ namespace gr {
       const gr_complex *in = (const gr_complex *) input_items[0];
       gr_complex *out = (gr_complex *) output_items[0];
 
+      perf_timer timer(d_estimator_ns);
+
       size_t i = 0;
       while ( i < noutput_items )
       {
@@ -75,7 +80,7 @@ namespace gr {
         float f_offset;
         float sps;
         calc_f_offset_and_sps(f_offset, sps, samples);
-        d_stored_freqs.push_back(f_offset);
+        d_stored_freqs.push(f_offset);
 
         // Set streamtag with detected sps
         add_item_tag(0, nitems_written(0) + i, pmt::intern("det_sps"), pmt::from_float(sps));
@@ -87,76 +92,101 @@ namespace gr {
         i += d_decimation;
       }
 
+      d_blocks.add(noutput_items / d_decimation);
+      d_tags.add(noutput_items / d_decimation);
+
       // Tell runtime system how many output items we produced.
       return noutput_items;
     }
 
+    float
+    freq_sps_det_impl::ft_refinement(short unsigned int rough_index, const gr_complex* samples, const short unsigned int refinem_f)
+    {
+      // Only reached from outside work, with no arrays in use
+      d_ws.reserve(workspace_size(refinem_f));
+      return refinement(rough_index, samples, refinem_f);
+    }
+
+    size_t
+    freq_sps_det_impl::workspace_size(int nsubdiv) const
+    {
+      const int n_points = nsubdiv + (nsubdiv % 2 == 0);
+      return 6 * workspace::bytes<gr_complex>(d_fft_size)
+        + 5 * workspace::bytes<float>(d_fft_size)
+        + workspace::bytes<gr_complex>(n_points)
+        + workspace::bytes<float>(n_points);
+    }
+
     // Returns the offset number of points from d_fft_size
     // consumes first d_decimation items of samples
     void
     freq_sps_det_impl::calc_f_offset_and_sps(float &f_offset, float &sps, const gr_complex* samples)
     { 
+      // d_fft_size == d_decimation
+      const int n = d_fft_size;
+      workspace::frame frame(d_ws);
+
       // Samples to the power of 2
-      gr_complex samples_2[d_fft_size];
-      volk_32fc_s32f_power_32fc(samples_2, samples, 2, d_decimation);
+      gr_complex *samples_2 = d_ws.alloc<gr_complex>(n);
+      kernels::power(samples_2, samples, 2, n);
       
       // Samples to the power of 4
-      gr_complex samples_4[d_fft_size];
-      volk_32fc_s32f_power_32fc(samples_4, samples_2, 2, d_decimation);
+      gr_complex *samples_4 = d_ws.alloc<gr_complex>(n);
+      kernels::power(samples_4, samples_2, 2, n);
       
       // Samples to the power of 8
-      gr_complex samples_8[d_fft_size];
-      volk_32fc_s32f_power_32fc(samples_8, samples_4, 2, d_decimation);
+      gr_complex *samples_8 = d_ws.alloc<gr_complex>(n);
+      kernels::power(samples_8, samples_4, 2, n);
       
       
       // Calculate FFTs
-      gr_complex samples_2_fft[d_fft_size];
-      memcpy(d_fft->get_inbuf(), samples_2, d_fft_size*sizeof(gr_complex));
+      gr_complex *samples_2_fft = d_ws.alloc<gr_complex>(n);
+      memcpy(d_fft->get_inbuf(), samples_2, n*sizeof(gr_complex));
       d_fft->execute();
-      memcpy(samples_2_fft, d_fft->get_outbuf(), d_fft_size*sizeof(gr_complex));
+      memcpy(samples_2_fft, d_fft->get_outbuf(), n*sizeof(gr_complex));
       
-      gr_complex samples_4_fft[d_fft_size];
-      memcpy(d_fft->get_inbuf(), samples_4, d_fft_size*sizeof(gr_complex));
+      gr_complex *samples_4_fft = d_ws.alloc<gr_complex>(n);
+      memcpy(d_fft->get_inbuf(), samples_4, n*sizeof(gr_complex));
       d_fft->execute();
-      memcpy(samples_4_fft, d_fft->get_outbuf(), d_fft_size*sizeof(gr_complex));
+      memcpy(samples_4_fft, d_fft->get_outbuf(), n*sizeof(gr_complex));
       
-      gr_complex samples_8_fft[d_fft_size];
-      memcpy(d_fft->get_inbuf(), samples_8, d_fft_size*sizeof(gr_complex));
+      gr_complex *samples_8_fft = d_ws.alloc<gr_complex>(n);
+      memcpy(d_fft->get_inbuf(), samples_8, n*sizeof(gr_complex));
       d_fft->execute();
-      memcpy(samples_8_fft, d_fft->get_outbuf(), d_fft_size*sizeof(gr_complex));
+      memcpy(samples_8_fft, d_fft->get_outbuf(), n*sizeof(gr_complex));
       
       // Magnitude of FFTs
-      float samples_2_abs_fft[d_fft_size];
-      volk_32fc_magnitude_32f(samples_2_abs_fft, samples_2_fft, d_fft_size);
+      float *samples_2_abs_fft = d_ws.alloc<float>(n);
+      volk_32fc_magnitude_32f(samples_2_abs_fft, samples_2_fft, n);
       
-      float samples_4_abs_fft[d_fft_size];
-      volk_32fc_magnitude_32f(samples_4_abs_fft, samples_4_fft, d_fft_size);
+      float *samples_4_abs_fft = d_ws.alloc<float>(n);
+      volk_32fc_magnitude_32f(samples_4_abs_fft, samples_4_fft, n);
       
-      float samples_8_abs_fft[d_fft_size];
-      volk_32fc_magnitude_32f(samples_8_abs_fft, samples_8_fft, d_fft_size);
+      float *samples_8_abs_fft = d_ws.alloc<float>(n);
+      volk_32fc_magnitude_32f(samples_8_abs_fft, samples_8_fft, n);
       
       
       // Calculate Maxima of FFTs
       short unsigned int maxIndex_2;
-      volk_32f_index_max_16u(&maxIndex_2, samples_2_abs_fft, d_fft_size);
+      volk_32f_index_max_16u(&maxIndex_2, samples_2_abs_fft, n);
       
       short unsigned int maxIndex_4;
-      volk_32f_index_max_16u(&maxIndex_4, samples_4_abs_fft, d_fft_size);
+      volk_32f_index_max_16u(&maxIndex_4, samples_4_abs_fft, n);
       
       short unsigned int maxIndex_8;
-      volk_32f_index_max_16u(&maxIndex_8, samples_8_abs_fft, d_fft_size);
+      volk_32f_index_max_16u(&maxIndex_8, samples_8_abs_fft, n);
       
       // Calculate quality criterion
       float samples_2_qc;
-      volk_32f_accumulator_s32f(&samples_2_qc, samples_2_abs_fft, d_fft_size);
+      volk_32f_accumulator_s32f(&samples_2_qc, samples_2_abs_fft, n);
       samples_2_qc = samples_2_abs_fft[maxIndex_2] / samples_2_qc;
       
       float samples_4_qc;
-      volk_32f_accumulator_s32f(&samples_4_qc, samples_4_abs_fft, d_fft_size);
+      volk_32f_accumulator_s32f(&samples_4_qc, samples_4_abs_fft, n);
       samples_4_qc = samples_4_abs_fft[maxIndex_4] / samples_4_qc;
       
       float samples_8_qc;
-      volk_32f_accumulator_s32f(&samples_8_qc, samples_8_abs_fft, d_fft_size);
+      volk_32f_accumulator_s32f(&samples_8_qc, samples_8_abs_fft, n);
       samples_8_qc = samples_8_abs_fft[maxIndex_8] / samples_8_qc;
       
       
@@ -178,7 +208,7 @@ namespace gr {
 
     }
 
-  inline void
+  void
   freq_sps_det_impl::f_shift_samples(gr_complex* output, const gr_complex* samples, float f_offset)
   {
     complexd exp_factor = d_m_j_2pi * complexd(f_offset);
@@ -194,12 +224,14 @@ namespace gr {
   inline float
   freq_sps_det_impl::calc_offset(const gr_complex* samples_x, short unsigned int maxIndex, float factor)
   {
+    const int n = d_fft_size;
+
     float f_offset;
 
     // Check if offset is negative
-    if (maxIndex > d_fft_size/2)
+    if (maxIndex > n/2)
     {
-      f_offset = (float) maxIndex - (float) d_fft_size;
+      f_offset = (float) maxIndex - (float) n;
     }
     else
     {
@@ -208,12 +240,12 @@ namespace gr {
 
     float fine_offset = 0;
     if (d_nsubdiv > 1) {
-      fine_offset = ft_refinement(maxIndex, samples_x, d_nsubdiv);
+      fine_offset = refinement(maxIndex, samples_x, d_nsubdiv);
     }
 
     f_offset = ((float)f_offset + (float)fine_offset) * factor;
 
-    return f_offset/float(d_fft_size);
+    return f_offset/float(n);
   }
 
   // Calculation of samples per symbol
@@ -221,6 +253,8 @@ namespace gr {
   inline float
   freq_sps_det_impl::calc_sps(float* samples_abs_fft, short unsigned int maxIndex)
   {
+    const int n = d_fft_size;
+
     float sps;
 
     // Find second highest peak
@@ -233,7 +267,7 @@ namespace gr {
       {
         if ((int) maxIndex + i < 0)
         {
-          samples_abs_fft[(int) maxIndex + i + d_fft_size] = 0;
+          samples_abs_fft[(int) maxIndex + i + n] = 0;
         }
         else
         {
@@ -242,51 +276,102 @@ namespace gr {
       }
 
     short unsigned int sps_index;
-    volk_32f_index_max_16u(&sps_index, samples_abs_fft, d_fft_size);
+    volk_32f_index_max_16u(&sps_index, samples_abs_fft, n);
 
     // Check if sps is negative
-    if (sps_index > d_fft_size/2) { sps = ((float) sps_index - (float) d_fft_size); }
+    if (sps_index > n/2) { sps = ((float) sps_index - (float) n); }
     else { sps = (float) sps_index; }
 
     // only works, if d_fft_size == d_decimation
     int f_offset_index;
-    if (maxIndex > d_fft_size/2)
-    { f_offset_index = (int) maxIndex - (int) d_fft_size; }
+    if (maxIndex > n/2)
+    { f_offset_index = (int) maxIndex - (int) n; }
     else { f_offset_index = (int) maxIndex; }
 
-    return std::abs(d_fft_size / (f_offset_index - sps));
+    return std::abs(n / (f_offset_index - sps));
   }
 
+  // ft_refinement within the arrays of calc_f_offset_and_sps
   float
-  freq_sps_det_impl::ft_refinement(short unsigned int rough_index, const gr_complex* samples, const short unsigned int refinem_f)
+  freq_sps_det_impl::refinement(short unsigned int rough_index, const gr_complex* samples, const short unsigned int refinem_f)
   {
-    float samples_real[d_decimation];
-    volk_32fc_deinterleave_real_32f(samples_real, samples, d_decimation);
-    float samples_imag[d_decimation];
-    volk_32fc_deinterleave_imag_32f(samples_imag, samples, d_decimation);
+    const int n = d_decimation;
+    workspace::frame frame(d_ws);
+
+    float *samples_real = d_ws.alloc<float>(n);
+    volk_32fc_deinterleave_real_32f(samples_real, samples, n);
+    float *samples_imag = d_ws.alloc<float>(n);
+    volk_32fc_deinterleave_imag_32f(samples_imag, samples, n);
 
     short unsigned int n_points = refinem_f;
     if ( refinem_f % 2 == 0 ) { n_points += 1; }
-    gr_complex ans_goertzel[n_points];
+    gr_complex *ans_goertzel = d_ws.alloc<gr_complex>(n_points);
     int d;
     gr_complex j(0,1);
     for (int i = 0; i < n_points; i++){
       d = (int)refinem_f * rough_index - (int)((float)(n_points-1) * 0.5)  + i;
-      if (d < 0) { d += (int)refinem_f * d_decimation; }
-      else if (d > refinem_f * d_decimation) { d -= (int)refinem_f * d_decimation; }
-      d_goertzel->set_params(d_decimation*refinem_f, d_decimation, d);
+      if (d < 0) { d += (int)refinem_f * n; }
+      else if (d > refinem_f * n) { d -= (int)refinem_f * n; }
+      d_goertzel->set_params(n*refinem_f, n, d);
       gr_complex bin_r = d_goertzel->batch(samples_real);
       gr_complex bin_i = d_goertzel->batch(samples_imag);
       ans_goertzel[i] = bin_r + j * bin_i;
     }
     short unsigned int maxIndex;
-    float ans_goertzel_abs[n_points];
+    float *ans_goertzel_abs = d_ws.alloc<float>(n_points);
     volk_32fc_magnitude_32f(ans_goertzel_abs, ans_goertzel, n_points);
     volk_32f_index_max_16u(&maxIndex, ans_goertzel_abs, n_points);
 
     return ((float) maxIndex - (float)(n_points-1) * 0.5)/(float)refinem_f;
   }
 
+    void
+    freq_sps_det_impl::reset_counters()
+    {
+      d_blocks.reset();
+      d_estimator_ns.reset();
+      d_tags.reset();
+      d_stored_freqs.reset_overflows();
+    }
+
+    void
+    freq_sps_det_impl::setup_rpc()
+    {
+#ifdef GR_CTRLPORT
+      add_rpc_variable(
+          rpcbasic_sptr(new rpcbasic_register_get<freq_sps_det, uint64_t>(
+	      alias(), "blocks processed",
+	      &freq_sps_det::get_blocks_processed,
+	      pmt::from_uint64(0), pmt::from_uint64(~0ULL), pmt::from_uint64(0),
+	      "blocks", "Decimation blocks estimated", RPC_PRIVLVL_MIN,
+              DISPTIME | DISPOPTSTRIP)));
+
+      add_rpc_variable(
+          rpcbasic_sptr(new rpcbasic_register_get<freq_sps_det, double>(
+	      alias(), "estimator time",
+	      &freq_sps_det::get_estimator_time,
+	      pmt::mp(0.0), pmt::mp(1e9), pmt::mp(0.0),
+	      "s", "Time spent estimating and correcting", RPC_PRIVLVL_MIN,
+              DISPTIME | DISPOPTSTRIP)));
+
+      add_rpc_variable(
+          rpcbasic_sptr(new rpcbasic_register_get<freq_sps_det, uint64_t>(
+	      alias(), "tags emitted",
+	      &freq_sps_det::get_tags_emitted,
+	      pmt::from_uint64(0), pmt::from_uint64(~0ULL), pmt::from_uint64(0),
+	      "tags", "det_sps tags added", RPC_PRIVLVL_MIN,
+              DISPTIME | DISPOPTSTRIP)));
+
+      add_rpc_variable(
+          rpcbasic_sptr(new rpcbasic_register_get<freq_sps_det, uint64_t>(
+	      alias(), "probe overflows",
+	      &freq_sps_det::get_probe_overflows,
+	      pmt::from_uint64(0), pmt::from_uint64(~0ULL), pmt::from_uint64(0),
+	      "values", "Offsets dropped on a full store", RPC_PRIVLVL_MIN,
+              DISPTIME | DISPOPTSTRIP)));
+#endif /* GR_CTRLPORT */
+    }
+
   } /* namespace cbmc */
 } /* namespace gr */
 
@@ -24,11 +24,14 @@
 #include <cbmc/freq_sps_det.h>
 #include <gnuradio/fft/fft.h>
 #include <gnuradio/fft/goertzel.h>
+#include "perf_counters.h"
+#include "workspace.h"
+#include "probe_buffer.h"
 
 namespace gr {
   namespace cbmc {
 
-    class freq_sps_det_impl : public freq_sps_det
+    class CBMC_API freq_sps_det_impl : public freq_sps_det
     {
      private:
       typedef std::complex<double>     complexd;
@@ -41,10 +44,21 @@ namespace gr {
       fft::goertzel          *d_goertzel;
       complexd                d_phase;
       short unsigned int      d_nsubdiv;
-      std::vector<float>      d_stored_freqs;
+      probe_buffer<float>     d_stored_freqs;
+      workspace               d_ws;
+
+      // Performance counters
+      perf_counter            d_blocks;
+      perf_counter            d_estimator_ns;
+      perf_counter            d_tags;
+
+      float refinement(short unsigned int rough_freq, const gr_complex* samples, const short unsigned int refinem_f);
+
+      // Scratch needed by calc_f_offset_and_sps with the refinement
+      size_t workspace_size(int nsubdiv) const;
 
      public:
-      freq_sps_det_impl(int decimation, int fft_size);
+      freq_sps_det_impl(int decimation, int fft_size, size_t probe_capacity);
       ~freq_sps_det_impl();
 
       int work(int noutput_items,
@@ -53,7 +67,17 @@ namespace gr {
 
       std::vector<float> get_stored_freqs() const
       {
-        return d_stored_freqs;
+        return d_stored_freqs.snapshot();
+      }
+
+      std::vector<float> drain_stored_freqs()
+      {
+        return d_stored_freqs.drain();
+      }
+
+      size_t drain_stored_freqs_into(float *out, size_t max)
+      {
+        return d_stored_freqs.drain(out, max);
       }
 
       void discard_stored_freqs()
@@ -61,8 +85,17 @@ namespace gr {
         d_stored_freqs.clear();
       }
 
+      uint64_t get_probe_overflows() const { return d_stored_freqs.overflows(); }
+
+      uint64_t get_blocks_processed() const { return d_blocks.value(); }
+      double get_estimator_time() const { return d_estimator_ns.seconds(); }
+      uint64_t get_tags_emitted() const { return d_tags.value(); }
+      void reset_counters();
+
+      void setup_rpc();
+
       void calc_f_offset_and_sps(float &f_offset, float &sps, const gr_complex* samples);
-      inline void f_shift_samples(gr_complex* output, const gr_complex* samples, float f_offset);
+      void f_shift_samples(gr_complex* output, const gr_complex* samples, float f_offset);
       inline float calc_offset(const gr_complex* samples_x, short unsigned int MaxIndex, float factor);
       inline float calc_sps(float* samples_abs_fft, short unsigned int maxIndex);
       float ft_refinement(short unsigned int rough_freq, const gr_complex* samples, const short unsigned int refinem_f);
@@ -0,0 +1,229 @@
+/* -*- c++ -*- */
+/* 
+ * Copyright 2016 <+YOU OR YOUR COMPANY+>.
+ * 
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ * 
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "kernels.h"
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+
+// AVX2 versions need the GCC target pragma, other compilers only get
+// the generic kernels
+#if defined(__GNUC__) && !defined(__clang__) && (defined(__x86_64__) || defined(__i386__))
+#define CBMC_KERNELS_AVX2
+#endif
+
+namespace gr {
+  namespace cbmc {
+    namespace kernels {
+
+      namespace generic {
+#include "kernels_arch.h"
+      }
+
+#ifdef CBMC_KERNELS_AVX2
+#pragma GCC push_options
+#pragma GCC target("avx2,fma")
+      namespace avx2 {
+#include "kernels_arch.h"
+      }
+#pragma GCC pop_options
+#endif
+
+      struct arch
+      {
+	const char  *name;
+	const table *kernels;
+	bool (*supported)();
+      };
+
+      static bool always() { return true; }
+
+#ifdef CBMC_KERNELS_AVX2
+      static bool
+      has_avx2()
+      {
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+      }
+#endif
+
+      // Most specific last
+      static const arch archs[] = {
+	{ "generic", &generic::kernel_table, &always },
+#ifdef CBMC_KERNELS_AVX2
+	{ "avx2", &avx2::kernel_table, &has_avx2 },
+#endif
+      };
+      static const int narchs = sizeof(archs) / sizeof(archs[0]);
+
+      static const char *names[] = { "power", "power_sum", "sum", "dot", "dot_conj" };
+      static const int nkernels = sizeof(names) / sizeof(names[0]);
+
+      // Active table and the architecture of each kernel in it
+      static table d_active;
+      static int   d_arch[nkernels];
+
+      static int
+      find_arch(const std::string &name)
+      {
+	for(int a = 0; a < narchs; a++) {
+	  if(name == archs[a].name && archs[a].supported()) {
+	    return a;
+	  }
+	}
+	return -1;
+      }
+
+      static int
+      find_kernel(const std::string &name)
+      {
+	for(int k = 0; k < nkernels; k++) {
+	  if(name == names[k]) {
+	    return k;
+	  }
+	}
+	return -1;
+      }
+
+      static void
+      set(int k, int a)
+      {
+	const table *t = archs[a].kernels;
+	switch(k) {
+	case 0:
+	  for(int s = 0; s < 3; s++) {
+	    d_active.power[s] = t->power[s];
+	  }
+	  break;
+	case 1:
+	  for(int s = 0; s < 3; s++) {
+	    d_active.power_sum[s] = t->power_sum[s];
+	  }
+	  break;
+	case 2: d_active.sum = t->sum; break;
+	case 3: d_active.dot = t->dot; break;
+	case 4: d_active.dot_conj = t->dot_conj; break;
+	}
+	d_arch[k] = a;
+      }
+
+      static bool
+      init()
+      {
+	int best = 0;
+	for(int a = 0; a < narchs; a++) {
+	  if(archs[a].supported()) {
+	    best = a;
+	  }
+	}
+	const char *force = getenv("CBMC_KERNEL_ARCH");
+	if(force && find_arch(force) >= 0) {
+	  best = find_arch(force);
+	}
+	for(int k = 0; k < nkernels; k++) {
+	  set(k, best);
+	}
+
+	// Lines of "kernel arch" from cbmc-profile
+	if(!force) {
+	  std::ifstream config(kernel_config().c_str());
+	  std::string line;
+	  while(std::getline(config, line)) {
+	    std::istringstream words(line);
+	    std::string kernel, arch;
+	    if(line.empty() || line[0] == '#' || !(words >> kernel >> arch)) {
+	      continue;
+	    }
+	    int k = find_kernel(kernel);
+	    int a = find_arch(arch);
+	    if(k >= 0 && a >= 0) {
+	      set(k, a);
+	    }
+	  }
+	}
+	return true;
+      }
+
+      const table &
+      active()
+      {
+	static bool done = init();
+	(void)done;
+	return d_active;
+      }
+
+      std::vector<std::string>
+      kernel_names()
+      {
+	return std::vector<std::string>(names, names + nkernels);
+      }
+
+      std::vector<std::string>
+      arch_names()
+      {
+	std::vector<std::string> r;
+	for(int a = 0; a < narchs; a++) {
+	  if(archs[a].supported()) {
+	    r.push_back(archs[a].name);
+	  }
+	}
+	return r;
+      }
+
+      bool
+      select(const std::string &kernel, const std::string &arch)
+      {
+	active();
+	int k = find_kernel(kernel);
+	int a = find_arch(arch);
+	if(k < 0 || a < 0) {
+	  return false;
+	}
+	set(k, a);
+	return true;
+      }
+
+      std::string
+      selected(const std::string &kernel)
+      {
+	active();
+	int k = find_kernel(kernel);
+	return k < 0 ? "" : archs[d_arch[k]].name;
+      }
+
+      std::string
+      kernel_config()
+      {
+	const char *path = getenv("CBMC_KERNEL_CONFIG");
+	if(path) {
+	  return path;
+	}
+	const char *home = getenv("HOME");
+	return std::string(home ? home : ".") + "/.cbmc/kernel_config";
+      }
+
+    } /* namespace kernels */
+  } /* namespace cbmc */
+} /* namespace gr */
@@ -0,0 +1,129 @@
+/* -*- c++ -*- */
+/* 
+ * Copyright 2016 <+YOU OR YOUR COMPANY+>.
+ * 
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ * 
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef INCLUDED_CBMC_KERNELS_H
+#define INCLUDED_CBMC_KERNELS_H
+
+#include <cbmc/api.h>
+#include <gnuradio/gr_complex.h>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace gr {
+  namespace cbmc {
+    namespace kernels {
+
+      /*
+       * The arithmetic kernels of the estimators, with one implementation
+       * per instruction set and the fastest supported one selected at
+       * first use, like VOLK does:
+       *
+       * - a kernel named in the config file (kernel_config(), written by
+       *   cbmc-profile) is used if this CPU supports it,
+       * - otherwise the most specific implementation this CPU supports.
+       *
+       * CBMC_KERNEL_ARCH=generic in the environment forces one
+       * implementation for all kernels.
+       *
+       * Powers are computed by repeated complex squaring, reductions keep
+       * several partial sums so they vectorize; the results differ from a
+       * serial sum in the last bits.
+       */
+      struct table
+      {
+	// x^(2^(s+1)) for s = 0, 1, 2: x^2, x^4 and x^8
+	void (*power[3])(gr_complex *out, const gr_complex *in, int n);
+	gr_complex (*power_sum[3])(const gr_complex *in, int n);
+	gr_complex (*sum)(const gr_complex *in, int n);
+	gr_complex (*dot)(const gr_complex *a, const gr_complex *b, int n);
+	gr_complex (*dot_conj)(const gr_complex *a, const gr_complex *b, int n);
+      };
+
+      CBMC_API const table &active();
+
+      // Squarings for the exponent r, r = 2, 4 or 8
+      inline int
+      squarings(int r)
+      {
+	switch(r) {
+	case 2: return 0;
+	case 4: return 1;
+	case 8: return 2;
+	default:
+	  throw std::invalid_argument("kernels: power must be 2, 4 or 8");
+	}
+      }
+
+      // out[i] = in[i]^r, in place allowed
+      inline void
+      power(gr_complex *out, const gr_complex *in, int r, int n)
+      {
+	active().power[squarings(r)](out, in, n);
+      }
+
+      // Sum of in[i]^r without storing the powers
+      inline gr_complex
+      power_sum(const gr_complex *in, int r, int n)
+      {
+	return active().power_sum[squarings(r)](in, n);
+      }
+
+      inline gr_complex
+      sum(const gr_complex *in, int n)
+      {
+	return active().sum(in, n);
+      }
+
+      // Sum of a[i] * b[i]
+      inline gr_complex
+      dot(const gr_complex *a, const gr_complex *b, int n)
+      {
+	return active().dot(a, b, n);
+      }
+
+      // Sum of a[i] * conj(b[i])
+      inline gr_complex
+      dot_conj(const gr_complex *a, const gr_complex *b, int n)
+      {
+	return active().dot_conj(a, b, n);
+      }
+
+      // Kernel names, as used in the config file
+      CBMC_API std::vector<std::string> kernel_names();
+
+      // Implementations compiled in and supported by this CPU,
+      // most specific last
+      CBMC_API std::vector<std::string> arch_names();
+
+      // Selects one implementation of a kernel, false if either is
+      // unknown or the CPU lacks the instructions. Not synchronized
+      // with running blocks, meant for tests and the profiler.
+      CBMC_API bool select(const std::string &kernel, const std::string &arch);
+      CBMC_API std::string selected(const std::string &kernel);
+
+      // $CBMC_KERNEL_CONFIG, or ~/.cbmc/kernel_config
+      CBMC_API std::string kernel_config();
+
+    } /* namespace kernels */
+  } /* namespace cbmc */
+} /* namespace gr */
+
+#endif /* INCLUDED_CBMC_KERNELS_H */
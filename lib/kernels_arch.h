@@ -0,0 +1,138 @@
+/* -*- c++ -*- */
+/* 
+ * Copyright 2016 <+YOU OR YOUR COMPANY+>.
+ * 
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ * 
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/*
+ * Kernel bodies, included by kernels.cc once per architecture inside
+ * its namespace and target options, so no include guard. Plain float
+ * code: the compiler vectorizes it for the target.
+ *
+ * power_sum computes a block of powers into a small buffer and adds it
+ * to eight interleaved partial sums. Both loops vectorize, while a
+ * single loop doing both does not. dot keeps eight partial sums per
+ * part, which vectorizes as is.
+ */
+
+static const int block = 64;
+
+// S squarings of re + j im
+template<int S>
+static inline void
+square(float &re, float &im)
+{
+  for(int s = 0; s < S; s++) {
+    float t = re*re - im*im;
+    im = 2*re*im;
+    re = t;
+  }
+}
+
+// Adds m interleaved floats to the partial sums
+static inline void
+add_lanes(float *acc, const float *x, int m)
+{
+  int k = 0;
+  for(; k + 8 <= m; k += 8) {
+    for(int l = 0; l < 8; l++) {
+      acc[l] += x[k + l];
+    }
+  }
+  for(; k < m; k += 2) {
+    acc[0] += x[k];
+    acc[1] += x[k + 1];
+  }
+}
+
+static inline gr_complex
+total(const float *acc)
+{
+  return gr_complex((acc[0] + acc[2]) + (acc[4] + acc[6]),
+                    (acc[1] + acc[3]) + (acc[5] + acc[7]));
+}
+
+template<int S>
+static void
+power(gr_complex *out, const gr_complex *in, int n)
+{
+  const float *x = (const float*)in;
+  float *y = (float*)out;
+  for(int i = 0; i < 2*n; i += 2) {
+    float re = x[i], im = x[i+1];
+    square<S>(re, im);
+    y[i] = re;
+    y[i+1] = im;
+  }
+}
+
+template<int S>
+static gr_complex
+power_sum(const gr_complex *in, int n)
+{
+  float acc[8] = {0, 0, 0, 0, 0, 0, 0, 0};
+  float terms[2*block];
+  for(int i = 0; i < n; i += block) {
+    int m = std::min(block, n - i);
+    power<S>((gr_complex*)terms, in + i, m);
+    add_lanes(acc, terms, 2*m);
+  }
+  return total(acc);
+}
+
+static gr_complex
+sum(const gr_complex *in, int n)
+{
+  float acc[8] = {0, 0, 0, 0, 0, 0, 0, 0};
+  add_lanes(acc, (const float*)in, 2*n);
+  return total(acc);
+}
+
+// Sum of a*b, or of a*conj(b), in eight complex partial sums
+template<bool CONJ>
+static gr_complex
+dot(const gr_complex *a, const gr_complex *b, int n)
+{
+  const float *x = (const float*)a;
+  const float *y = (const float*)b;
+  const float sign = CONJ ? -1 : 1;
+  float are[8] = {0, 0, 0, 0, 0, 0, 0, 0};
+  float aim[8] = {0, 0, 0, 0, 0, 0, 0, 0};
+  int i = 0;
+  for(; i + 8 <= n; i += 8) {
+    for(int l = 0; l < 8; l++) {
+      int k = 2*(i+l);
+      are[l] += x[k]*y[k] - sign*x[k+1]*y[k+1];
+      aim[l] += x[k+1]*y[k] + sign*x[k]*y[k+1];
+    }
+  }
+  for(; i < n; i++) {
+    int k = 2*i;
+    are[0] += x[k]*y[k] - sign*x[k+1]*y[k+1];
+    aim[0] += x[k+1]*y[k] + sign*x[k]*y[k+1];
+  }
+  return gr_complex(((are[0] + are[1]) + (are[2] + are[3])) + ((are[4] + are[5]) + (are[6] + are[7])),
+                    ((aim[0] + aim[1]) + (aim[2] + aim[3])) + ((aim[4] + aim[5]) + (aim[6] + aim[7])));
+}
+
+static const table kernel_table = {
+  { &power<1>, &power<2>, &power<3> },
+  { &power_sum<1>, &power_sum<2>, &power_sum<3> },
+  &sum,
+  &dot<false>,
+  &dot<true>
+};
@@ -24,29 +24,35 @@
 
 #include <gnuradio/io_signature.h>
 #include "modulation_classifier_impl.h"
-#include <numeric> // for accumulate
+#include "kernels.h"
+#include <limits>
+#include <cmath>
 #include <volk/volk.h>
 
 namespace gr {
   namespace cbmc {
 
     modulation_classifier::sptr
-    modulation_classifier::make(int decimation, bool probe)
+    modulation_classifier::make(int decimation, bool probe, size_t probe_capacity)
     {
       return gnuradio::get_initial_sptr
-        (new modulation_classifier_impl(decimation, probe));
+        (new modulation_classifier_impl(decimation, probe, probe_capacity));
     }
 
     /*
      * The private constructor
      */
-    modulation_classifier_impl::modulation_classifier_impl(int decimation, bool probe)
+    modulation_classifier_impl::modulation_classifier_impl(int decimation, bool probe, size_t probe_capacity)
       : gr::sync_block("modulation_classifier",
               gr::io_signature::make(1, 1, sizeof(gr_complex)),
               gr::io_signature::make(1, 1, sizeof(gr_complex))),
-        d_decimation(decimation), d_probe_enabled(probe)
+        d_decimation(decimation), d_probe_enabled(probe),
+        d_stored(probe_capacity), d_snr(0)
     {
     set_output_multiple(d_decimation);
+
+    // Shifted samples in work and the squares in the cumulants
+    d_ws.reserve(2 * workspace::bytes<gr_complex>(d_decimation));
     }
 
     /*
@@ -64,6 +70,8 @@ namespace gr {
       const gr_complex *in = (const gr_complex *) input_items[0];
       gr_complex *out = (gr_complex *) output_items[0];
       
+      perf_timer timer(d_estimator_ns);
+
       size_t i = 0;
       while ( i < noutput_items )
       {
@@ -71,11 +79,11 @@ namespace gr {
         const gr_complex* samples = in + i;
 
         // Decide which modulation has been received and phase shift
-        gr_complex samples_shifted[d_decimation];
-        unsigned int det_mod_index = detMod2(samples_shifted, samples);
-        if (d_probe_enabled) {
-          d_stored_mod.push_back(det_mod_index);
-        }
+        workspace::frame frame(d_ws);
+        gr_complex *samples_shifted = d_ws.alloc<gr_complex>(d_decimation);
+        float snr;
+        unsigned int det_mod_index = detMod2(samples_shifted, snr, samples);
+        d_snr = snr;
 
         // Assignment of Modulations to Indexes
         std::string det_mod = "";
@@ -105,6 +113,9 @@ namespace gr {
                 pmt::mp(det_mod) // Value
         );
 
+        // Set streamtag with the estimated SNR in dB
+        add_item_tag(0, nitems_written(0) + i, pmt::intern("snr"), pmt::from_float(snr));
+
         /*
         // Verification of modulation detection
         // Compares the detected Modulation with the one specified in a stream tag "sent_mod"
@@ -152,6 +163,9 @@ namespace gr {
         
         i += d_decimation;
       }
+
+      d_blocks.add(noutput_items / d_decimation);
+      d_tags.add(2 * (noutput_items / d_decimation));
       
       // Tell runtime system how many output items we produced.
       return noutput_items;
@@ -160,87 +174,88 @@ namespace gr {
     // Computes normalized cumulants
     // real part would be sufficient
     // consumes d_decimation samples and c_2_1
+    // also returns the fourth-order moment E{|x|^4} in m_4_2
     void
-    modulation_classifier_impl::computeCumulant_4_0_u_4_2(gr_complex &c_4_0, gr_complex &c_4_2, const gr_complex* samples, gr_complex c_2_1)
+    modulation_classifier_impl::computeCumulant_4_0_u_4_2(gr_complex &c_4_0, gr_complex &c_4_2, gr_complex &m_4_2, const gr_complex* samples, gr_complex c_2_1)
     {
+      const int n = d_decimation;
+      workspace::frame frame(d_ws);
+
       // Samples squared
-      gr_complex samples_pot[d_decimation];
-      volk_32fc_s32f_power_32fc(samples_pot, samples, 2, d_decimation);
+      gr_complex *samples_pot = d_ws.alloc<gr_complex>(n);
+      kernels::power(samples_pot, samples, 2, n);
       
-      gr_complex c_2_0 = std::accumulate(samples_pot, samples_pot + d_decimation, gr_complex{0}) * a_factor;
+      gr_complex c_2_0 = kernels::sum(samples_pot, n) * a_factor;
       
       // Cumulant 4_2
       //
-      // Complex conjugate of samples
-      gr_complex samples_con[d_decimation];
-      volk_32fc_conjugate_32fc(samples_con, samples, d_decimation);
-      
-      // Conjugate samples sqared
-      volk_32fc_s32f_power_32fc(samples_con, samples_con, 2, d_decimation);
-      
-      // Mean of conjugate samples squared
-      gr_complex mean_c_sq = std::accumulate(samples_con, samples_con + d_decimation, gr_complex{0}) * a_factor;
-      
-      // Conjugate samples squared multiplied by samples squared: stored -> samples_con
-      volk_32fc_x2_multiply_32fc(samples_con, samples_con, samples_pot, d_decimation);
+      // Mean of conjugate samples squared, the conjugate of c_2_0
+      gr_complex mean_c_sq = std::conj(c_2_0);
       
       // Mean of (samples squared multiplied by conjugate samples squared)
-      gr_complex mean_c_sq_sq = std::accumulate(samples_con, samples_con + d_decimation, gr_complex{0}) * a_factor;
+      gr_complex mean_c_sq_sq = kernels::dot_conj(samples_pot, samples_pot, n) * a_factor;
+      m_4_2 = mean_c_sq_sq;
       
       c_4_2 = (mean_c_sq_sq - c_2_0 * mean_c_sq - (gr_complex) 2 * pow(c_2_1,2));
       
       // Cumulant 4_0
       //
-      // Samples to the power of 4
-      volk_32fc_s32f_power_32fc(samples_pot, samples_pot, 2, d_decimation);
-      
       // Mean of samples to the power of 4
-      gr_complex mean_tdpo4 = std::accumulate(samples_pot, samples_pot + d_decimation, gr_complex{0}) * a_factor;
+      gr_complex mean_tdpo4 = kernels::dot(samples_pot, samples_pot, n) * a_factor;
       
       c_4_0 = (mean_tdpo4 - (gr_complex) 3 * pow(c_2_0,2))/pow(c_2_1,2);//normalized with c_2_1
-      
-      
     }
 
     gr_complex
     modulation_classifier_impl::computeCumulant_2_1(const gr_complex* samples)
     {
-      gr_complex samples_norm[d_decimation];
-      volk_32fc_x2_multiply_conjugate_32fc(samples_norm, samples, samples, d_decimation);
+      const int n = d_decimation;
 
-      return std::accumulate(samples_norm, samples_norm + d_decimation, gr_complex{0}) * a_factor;
+      return kernels::dot_conj(samples, samples, n) * a_factor;
     }
     
     // Returns estimated phase, input: r = {2,4,8}
     float
     modulation_classifier_impl::phaseEstim(unsigned int r, float my, const gr_complex* samples)
     {
-      gr_complex samples_c[d_decimation];
-      // square first time
-      volk_32fc_s32f_power_32fc(samples_c, samples, 2, d_decimation);
-      
-      switch(r){
-        case 8:
-          // square second time
-          volk_32fc_s32f_power_32fc(samples_c, samples_c, 2, d_decimation);
-        case 4:
-          // square third time
-          volk_32fc_s32f_power_32fc(samples_c, samples_c, 2, d_decimation);
-        case 2:
-          break;
-        default:
-          return(0);
+      const int n = d_decimation;
+
+      if (r != 2 && r != 4 && r != 8) {
+        return(0);
       }
 
-      gr_complex sum_to_the_r = std::accumulate(samples_c, samples_c + d_decimation, gr_complex{0});
+      gr_complex sum_to_the_r = kernels::power_sum(samples, r, n);
       return 1 / (float) r * std::arg(my * sum_to_the_r);;
     }
 
     void
     modulation_classifier_impl::phaseShift(gr_complex* samples_shifted, const gr_complex* samples, float phi)
     {
+      const int n = d_decimation;
+
       lv_32fc_t scalar = lv_cmake((float)std::cos(phi), (float)std::sin(phi));
-      volk_32fc_s32fc_multiply_32fc(samples_shifted, samples, scalar, d_decimation);
+      volk_32fc_s32fc_multiply_32fc(samples_shifted, samples, scalar, n);
+    }
+
+    // M2M4 SNR estimate in dB from the moments E{|x|^2} and E{|x|^4}
+    // Assumes complex gaussian noise (kurtosis 2) and the signal kurtosis
+    // of the detected modulation, so no additional pass over the samples is needed
+    float
+    modulation_classifier_impl::estimateSNR(float m_2, float m_4, unsigned int det_mod_index)
+    {
+      // kurtosis E{|s|^4}/E{|s|^2}^2 of the constellation, 16QAM: 1.32, PSK: 1
+      const float k_a = (det_mod_index == 1) ? 1.32 : 1.0;
+
+      float s_sq = (2 * m_2 * m_2 - m_4) / (2 - k_a);
+      if (s_sq <= 0) {
+        return -std::numeric_limits<float>::infinity();
+      }
+      float s = std::sqrt(s_sq);
+      float n = m_2 - s;
+      if (n <= 0) {
+        return std::numeric_limits<float>::infinity();
+      }
+      return 10 * std::log10(s / n);
     }
 
     // use real part of the cumulant, does not work properly with phase shift
@@ -255,6 +270,7 @@ namespace gr {
       float phi = 0;
       gr_complex c_4_0 = 0;
       gr_complex c_4_2 = 0;
+      gr_complex m_4_2 = 0;
       gr_complex c_2_1 = computeCumulant_2_1(samples);
       
       // Asume BPSK
@@ -262,7 +278,7 @@ namespace gr {
       
       phaseShift(samples_shifted, samples, -phi);
       
-      computeCumulant_4_0_u_4_2(c_4_0, c_4_2, samples_shifted, c_2_1); // Compute Cumulants
+      computeCumulant_4_0_u_4_2(c_4_0, c_4_2, m_4_2, samples_shifted, c_2_1); // Compute Cumulants
       if ( c_4_0.real() < b1)
       {
         return 3; //"BPSK"
@@ -273,7 +289,7 @@ namespace gr {
       
       phaseShift(samples_shifted, samples, -phi);
       
-      computeCumulant_4_0_u_4_2(c_4_0, c_4_2, samples_shifted, c_2_1); // Compute Cumulants
+      computeCumulant_4_0_u_4_2(c_4_0, c_4_2, m_4_2, samples_shifted, c_2_1); // Compute Cumulants
       if ( c_4_0.real() > b1 && c_4_0.real() < b2)
       {
         return 1; //"16QAM"
@@ -284,7 +300,7 @@ namespace gr {
       
       phaseShift(samples_shifted, samples, -phi);
       
-      computeCumulant_4_0_u_4_2(c_4_0, c_4_2, samples_shifted, c_2_1); // Compute Cumulants
+      computeCumulant_4_0_u_4_2(c_4_0, c_4_2, m_4_2, samples_shifted, c_2_1); // Compute Cumulants
       if ( c_4_0.real() > b3) 
       {
         return 2; //"QPSK"
@@ -295,7 +311,7 @@ namespace gr {
       
       phaseShift(samples_shifted, samples, -phi);
       
-      computeCumulant_4_0_u_4_2(c_4_0, c_4_2, samples_shifted, c_2_1); // Compute Cumulants
+      computeCumulant_4_0_u_4_2(c_4_0, c_4_2, m_4_2, samples_shifted, c_2_1); // Compute Cumulants
       return 0; //"8PSK"
       
     }
@@ -304,7 +320,7 @@ namespace gr {
     // use the absolute value of the cumulant
     // No phase shift in the first place
     unsigned int
-    modulation_classifier_impl::detMod2(gr_complex* samples_shifted, const gr_complex* samples)
+    modulation_classifier_impl::detMod2(gr_complex* samples_shifted, float &snr, const gr_complex* samples)
     {
       // set boundries
       const float b1 = 0.34;
@@ -314,19 +330,18 @@ namespace gr {
       float phi = 0;
       gr_complex c_4_0 = 0;
       gr_complex c_4_2 = 0;
+      gr_complex m_4_2 = 0;
       gr_complex c_2_1 = computeCumulant_2_1(samples);
 
-      computeCumulant_4_0_u_4_2(c_4_0, c_4_2, samples, c_2_1); // Compute Cumulants
-      if (d_probe_enabled==true) {
-        d_stored_cumu.push_back(abs(c_4_0));
-      }
+      computeCumulant_4_0_u_4_2(c_4_0, c_4_2, m_4_2, samples, c_2_1); // Compute Cumulants
 
       // Asume 8PSK
       if ( abs(c_4_0) < b1)
       {
         phi = phaseEstim(8, 1, samples);
         phaseShift(samples_shifted, samples, -phi);
-        return 0; //"8PSK"
+        snr = estimateSNR(c_2_1.real(), m_4_2.real(), 0);
+        return store_probe(0, c_4_0); //"8PSK"
       }
       
       // Asume 16QAM
@@ -334,7 +349,8 @@ namespace gr {
       {
         phi = phaseEstim(4, -0.68, samples);
         phaseShift(samples_shifted, samples, -phi);
-        return 1; //"16QAM"
+        snr = estimateSNR(c_2_1.real(), m_4_2.real(), 1);
+        return store_probe(1, c_4_0); //"16QAM"
       }
       
       // Asume QPSK
@@ -342,13 +358,75 @@ namespace gr {
       {
         phi = phaseEstim(4, 1, samples);
         phaseShift(samples_shifted, samples, -phi);
-        return 2; //"QPSK"
+        snr = estimateSNR(c_2_1.real(), m_4_2.real(), 2);
+        return store_probe(2, c_4_0); //"QPSK"
       }
       
       // Asume BPSK
       phi = phaseEstim(2, 1, samples);
       phaseShift(samples_shifted, samples, -phi);
-      return 3; //"BPSK"
+      snr = estimateSNR(c_2_1.real(), m_4_2.real(), 3);
+      return store_probe(3, c_4_0); //"BPSK"
+    }
+
+    // Stores the decision and |C40| of a block if probing, returns mod
+    unsigned int
+    modulation_classifier_impl::store_probe(unsigned int mod, gr_complex c_4_0)
+    {
+      if (d_probe_enabled) {
+        mod_probe p;
+        p.mod = mod;
+        p.cumu = abs(c_4_0);
+        d_stored.push(p);
+      }
+      return mod;
+    }
+
+    void
+    modulation_classifier_impl::reset_counters()
+    {
+      d_blocks.reset();
+      d_estimator_ns.reset();
+      d_tags.reset();
+      d_stored.reset_overflows();
+    }
+
+    void
+    modulation_classifier_impl::setup_rpc()
+    {
+#ifdef GR_CTRLPORT
+      add_rpc_variable(
+          rpcbasic_sptr(new rpcbasic_register_get<modulation_classifier, uint64_t>(
+	      alias(), "blocks processed",
+	      &modulation_classifier::get_blocks_processed,
+	      pmt::from_uint64(0), pmt::from_uint64(~0ULL), pmt::from_uint64(0),
+	      "blocks", "Decimation blocks classified", RPC_PRIVLVL_MIN,
+              DISPTIME | DISPOPTSTRIP)));
+
+      add_rpc_variable(
+          rpcbasic_sptr(new rpcbasic_register_get<modulation_classifier, double>(
+	      alias(), "estimator time",
+	      &modulation_classifier::get_estimator_time,
+	      pmt::mp(0.0), pmt::mp(1e9), pmt::mp(0.0),
+	      "s", "Time spent on cumulants, phase and SNR", RPC_PRIVLVL_MIN,
+              DISPTIME | DISPOPTSTRIP)));
+
+      add_rpc_variable(
+          rpcbasic_sptr(new rpcbasic_register_get<modulation_classifier, uint64_t>(
+	      alias(), "tags emitted",
+	      &modulation_classifier::get_tags_emitted,
+	      pmt::from_uint64(0), pmt::from_uint64(~0ULL), pmt::from_uint64(0),
+	      "tags", "det_mod and snr tags added", RPC_PRIVLVL_MIN,
+              DISPTIME | DISPOPTSTRIP)));
+
+      add_rpc_variable(
+          rpcbasic_sptr(new rpcbasic_register_get<modulation_classifier, uint64_t>(
+	      alias(), "probe overflows",
+	      &modulation_classifier::get_probe_overflows,
+	      pmt::from_uint64(0), pmt::from_uint64(~0ULL), pmt::from_uint64(0),
+	      "values", "Probe values dropped on a full store", RPC_PRIVLVL_MIN,
+              DISPTIME | DISPOPTSTRIP)));
+#endif /* GR_CTRLPORT */
     }
 
   } /* namespace cbmc */
@@ -22,22 +22,40 @@
 #define INCLUDED_CBMC_MODULATION_CLASSIFIER_IMPL_H
 
 #include <cbmc/modulation_classifier.h>
+#include "perf_counters.h"
+#include "workspace.h"
+#include "probe_buffer.h"
 
 namespace gr {
   namespace cbmc {
 
-    class modulation_classifier_impl : public modulation_classifier
+    class CBMC_API modulation_classifier_impl : public modulation_classifier
     {
      private:
       const int                   d_decimation;
       const float                 a_factor = 1.0/d_decimation;
       const double                pi = std::acos(-1);
+      // Decision and |C40| of one block, stored together so that the
+      // two probes always describe the same blocks
+      struct mod_probe {
+        unsigned int mod;
+        float        cumu;
+      };
+
       const bool                  d_probe_enabled;  // If enabled store last determined Modulations
-      std::vector<unsigned int>   d_stored_mod;     // Used to store last determined Modulations
-      std::vector<float>          d_stored_cumu;     // Used to store last calculated cumulants
+      probe_buffer<mod_probe>     d_stored;         // Used to store last determined Modulations and cumulants
+      float                       d_snr;            // Last M2M4 SNR estimate in dB
+      workspace                   d_ws;             // Scratch arrays of work and the kernels
+
+      // Performance counters
+      perf_counter                d_blocks;
+      perf_counter                d_estimator_ns;
+      perf_counter                d_tags;
+
+      unsigned int store_probe(unsigned int mod, gr_complex c_4_0);
 
      public:
-      modulation_classifier_impl(int decimation, bool probe);
+      modulation_classifier_impl(int decimation, bool probe, size_t probe_capacity);
       ~modulation_classifier_impl();
 
       // Where all the action really happens
@@ -48,28 +66,65 @@ namespace gr {
       // Get functions
       std::vector<unsigned int> get_stored_mod() const
       {
-        return d_stored_mod;
+        return d_stored.snapshot(&mod_probe::mod);
       }
 
       std::vector<float> get_stored_cumu() const
       {
-        return d_stored_cumu;
+        return d_stored.snapshot(&mod_probe::cumu);
+      }
+
+      std::vector<unsigned int> drain_stored_mod()
+      {
+        return d_stored.drain(&mod_probe::mod);
+      }
+
+      std::vector<float> drain_stored_cumu()
+      {
+        return d_stored.drain(&mod_probe::cumu);
+      }
+
+      size_t drain_stored_mod_into(unsigned int *out, size_t max)
+      {
+        return d_stored.drain(out, max, &mod_probe::mod);
+      }
+
+      size_t drain_stored_cumu_into(float *out, size_t max)
+      {
+        return d_stored.drain(out, max, &mod_probe::cumu);
+      }
+
+      uint64_t get_probe_overflows() const
+      {
+        return d_stored.overflows();
+      }
+
+      float get_snr() const
+      {
+        return d_snr;
       }
 
       // Reset
       void reset()
       {
-        d_stored_mod.clear();
-        d_stored_cumu.clear();
+        d_stored.clear();
       }
 
+      uint64_t get_blocks_processed() const { return d_blocks.value(); }
+      double get_estimator_time() const { return d_estimator_ns.seconds(); }
+      uint64_t get_tags_emitted() const { return d_tags.value(); }
+      void reset_counters();
+
+      void setup_rpc();
+
       //
       float phaseEstim(unsigned int r, float my, const gr_complex* samples);
       void phaseShift(gr_complex* samples_shifted, const gr_complex* samples, float phi);
-      void computeCumulant_4_0_u_4_2(gr_complex &c_4_0, gr_complex &c_4_2, const gr_complex* samples, gr_complex c_2_1);
+      void computeCumulant_4_0_u_4_2(gr_complex &c_4_0, gr_complex &c_4_2, gr_complex &m_4_2, const gr_complex* samples, gr_complex c_2_1);
       gr_complex computeCumulant_2_1(const gr_complex* samples);
       unsigned int detMod1(gr_complex* samples_shifted, const gr_complex* samples);
-      unsigned int detMod2(gr_complex* samples_shifted, const gr_complex* samples);
+      unsigned int detMod2(gr_complex* samples_shifted, float &snr, const gr_complex* samples);
+      float estimateSNR(float m_2, float m_4, unsigned int det_mod_index);
     };
 
   } // namespace cbmc
@@ -32,6 +32,13 @@
 #include <gnuradio/math.h>
 #include <boost/format.hpp>
 #include <boost/math/special_functions/round.hpp>
+#include <volk/volk.h>
+#ifdef __SSE__
+#include <xmmintrin.h>
+#endif
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 namespace gr {
   namespace cbmc {
@@ -42,7 +49,12 @@ namespace gr {
 			     float init_phase,
 			     float max_rate_deviation,
 			     int osps,
-			     unsigned int det_block_size)
+			     unsigned int det_block_size,
+			     interp_type interp,
+			     ted_type ted,
+			     float rolloff,
+			     float span,
+			     int window)
     {
       return gnuradio::get_initial_sptr
 	(new my_pfb_clock_sync_impl(sps, loop_bw,
@@ -50,7 +62,9 @@ namespace gr {
 				     init_phase,
 				     max_rate_deviation,
 				     osps,
-			       det_block_size));
+			       det_block_size,
+			       interp, ted,
+			       rolloff, span, window));
     }
 
     static int ios[] = {sizeof(gr_complex), sizeof(float), sizeof(float), sizeof(float)};
@@ -60,13 +74,26 @@ namespace gr {
 						     float init_phase,
 						     float max_rate_deviation,
 						     int osps,
-			           unsigned int det_block_size)
+			           unsigned int det_block_size,
+			           interp_type interp,
+			           ted_type ted,
+			           float rolloff,
+			           float span,
+			           int window)
       : block("my_pfb_clock_sync",
 		  io_signature::make(1, 1, sizeof(gr_complex)),
 		  io_signature::makev(1, 4, iosig)),
-	d_updated(false), d_nfilters(filter_size),
+	d_det_block_size(det_block_size), d_interp(interp), d_ted(ted),
+	d_requested_sps(0),
+	d_acq_bw(0), d_locked(false), d_lock_th(0.01),
+	d_lock_avg(1), d_lock_count(0), d_mailbox(NULL),
+	d_nfilters(filter_size), d_rejected_sps(0),
+	d_design_stop(false), d_job_pending(false), d_design_gen(0),
 	d_max_dev(max_rate_deviation),
-	d_osps(osps), d_det_block_size(det_block_size), d_error(0), d_out_idx(0)
+	d_osps(osps), d_error(0), d_out_idx(0),
+	d_max_latency(0), d_telem_decim(1), d_telem_count(0),
+	d_error_stats(64, 2.0), d_rate_stats(64, max_rate_deviation),
+	d_prev_sym(0), d_prev_dec(0), d_mid_sym(0)
     {
       // Let scheduler adjust our relative_rate.
       enable_update_rate(true);
@@ -74,10 +101,18 @@ namespace gr {
       d_nfilters = filter_size;
 
       // Set the damping factor for a critically damped system
-      d_damping = 2*d_nfilters;
-
-      // Set the bandwidth, which will then call update_gains()
+      d_req.damping = 2*d_nfilters;
+      d_req.acq_bw = 0;
+      d_req.lock_th = 0.01;
+      d_req.max_dev = max_rate_deviation;
+      d_req.telem_decim = 1;
+      d_req.max_latency = 0;
+      d_req.update_acq_gains();
+
+      // Set the bandwidth, which will then call update_gains(), and
+      // take the parameters over right away
       set_loop_bandwidth(loop_bw);
+      take_params();
 
       // Store the last filter between calls to work
       // The accumulator keeps track of overflow to increment the stride correctly.
@@ -85,200 +120,415 @@ namespace gr {
       d_k = init_phase;
       d_filtnum = (int)floor(d_k);
 
-      d_filters = std::vector<kernel::fir_filter_ccf*>(d_nfilters);
-      d_diff_filters = std::vector<kernel::fir_filter_ccf*>(d_nfilters);
+      select_kernels(false);
 
-      // Create an FIR filter for each channel and zero out the taps
-      std::vector<float> vtaps(1,0);
-      for(int i = 0; i < d_nfilters; i++) {
-	d_filters[i] = new kernel::fir_filter_ccf(1, vtaps);
-	d_diff_filters[i] = new kernel::fir_filter_ccf(1, vtaps);
+      if(rolloff <= 0 || rolloff > 1) {
+	throw std::out_of_range("my_pfb_clock_sync: invalid roll-off. Must be in (0, 1].");
       }
+      if(span < 0) {
+	throw std::out_of_range("my_pfb_clock_sync: invalid span. Must be >= 0.");
+      }
+      d_rrc.rolloff = rolloff;
+      d_rrc.span = span;
+      d_rrc.window = window;
+
+      // Reserve history for the largest sps up front. The scheduler
+      // does not support growing it while running, so banks that need
+      // more are rejected.
+      double max_sps = std::max(sps, (double)d_max_sps);
+      set_history(required_history(d_rrc.taps_per_filter(max_sps), max_sps));
 
       set_sps(sps);
+
+      message_port_register_in(pmt::mp("state_in"));
+      set_msg_handler(pmt::mp("state_in"),
+		      boost::bind(&my_pfb_clock_sync_impl::handle_state, this, _1));
+      message_port_register_out(pmt::mp("state_out"));
     }
 
     my_pfb_clock_sync_impl::~my_pfb_clock_sync_impl()
     {
-      for(int i = 0; i < d_nfilters; i++) {
-	delete d_filters[i];
-	delete d_diff_filters[i];
-      }
+      stop();
+      delete d_mailbox.exchange(NULL);
     }
 
     bool
-    my_pfb_clock_sync_impl::check_topology(int ninputs, int noutputs)
+    my_pfb_clock_sync_impl::start()
     {
-      return noutputs == 1 || noutputs == 4;
+      gr::thread::scoped_lock lock(d_design_mutex);
+      d_design_stop = false;
+      d_design_thread = gr::thread::thread(boost::bind(&my_pfb_clock_sync_impl::design_thread, this));
+      return block::start();
     }
 
-    void
-    my_pfb_clock_sync_impl::forecast(int noutput_items,
-                                      gr_vector_int &ninput_items_required)
+    bool
+    my_pfb_clock_sync_impl::stop()
     {
-      unsigned ninputs = ninput_items_required.size ();
-      for(unsigned i = 0; i < ninputs; i++)
-        ninput_items_required[i] = (noutput_items + history()) * (d_sps/d_osps);
+      {
+	gr::thread::scoped_lock lock(d_design_mutex);
+	d_design_stop = true;
+	d_design_cond.notify_one();
+      }
+      if(d_design_thread.joinable()) {
+	d_design_thread.join();
+      }
+      return block::stop();
+    }
+
+    running_stats::running_stats(int nbins, float range)
+      : hist(nbins)
+    {
+      set_range(range);
     }
 
     void
-    my_pfb_clock_sync_impl::update_taps(const std::vector<float> &taps)
+    running_stats::reset()
     {
-      d_updated_taps = taps;
-      d_updated = true;
+      n = sum = sumsq = 0;
+      std::fill(hist.begin(), hist.end(), 0);
     }
 
+    void
+    running_stats::set_range(float r)
+    {
+      range = r;
+      scale = hist.size() / (2*r);
+      reset();
+    }
 
-    /*******************************************************************
-     SET FUNCTIONS
-    *******************************************************************/
+    float
+    running_stats::mean() const
+    {
+      return (n > 0) ? sum/n : 0;
+    }
 
-    void
-    my_pfb_clock_sync_impl::set_loop_bandwidth(float bw)
+    float
+    running_stats::variance() const
     {
-      if(bw < 0) {
-	throw std::out_of_range("my_pfb_clock_sync: invalid bandwidth. Must be >= 0.");
+      if(n < 1) {
+	return 0;
       }
+      double m = sum/n;
+      return std::max(0.0, sumsq/n - m*m);
+    }
 
-      d_loop_bw = bw;
-      update_gains();
+    filter_bank::filter_bank(int nfilters, int taps_per_filter)
+      : nfilters(nfilters), taps_per_filter(taps_per_filter), dgain(1),
+	qstride(0), qcoeffs(NULL), qgain(0), qdgain(0)
+    {
+      // Round each filter up to an even number of taps, so every
+      // filter starts on a 16 byte boundary
+      stride = 2 * 2 * (taps_per_filter + (taps_per_filter & 1));
+      coeffs = (float*)volk_malloc(nfilters*stride*sizeof(float), volk_get_alignment());
+      std::fill(coeffs, coeffs + nfilters*stride, 0);
     }
 
-    void
-    my_pfb_clock_sync_impl::set_damping_factor(float df)
+    filter_bank::~filter_bank()
     {
-      if(df < 0 || df > 1.0) {
-	throw std::out_of_range("my_pfb_clock_sync: invalid damping factor. Must be in [0,1].");
+      volk_free(coeffs);
+      if(qcoeffs) {
+	volk_free(qcoeffs);
       }
-
-      d_damping = df;
-      update_gains();
     }
 
     void
-    my_pfb_clock_sync_impl::set_alpha(float alpha)
+    filter_bank::set_arm(int arm, const std::vector<float> &taps,
+			 const std::vector<float> &dtaps)
     {
-      if(alpha < 0 || alpha > 1.0) {
-	throw std::out_of_range("my_pfb_clock_sync: invalid alpha. Must be in [0,1].");
+      float *m = coeffs + arm*stride;
+      float *d = m + stride/2;
+      for(int j = 0; j < taps_per_filter; j++) {
+	int r = taps_per_filter - 1 - j;
+	m[2*r] = m[2*r+1] = taps[j];
+	d[2*r] = d[2*r+1] = dtaps[j];
       }
-      d_alpha = alpha;
     }
 
-    void
-    my_pfb_clock_sync_impl::set_beta(float beta)
+    std::vector<float>
+    filter_bank::arm_taps(int arm) const
     {
-      if(beta < 0 || beta > 1.0) {
-	throw std::out_of_range("my_pfb_clock_sync: invalid beta. Must be in [0,1].");
+      const float *m = matched(arm);
+      std::vector<float> taps(taps_per_filter);
+      for(int j = 0; j < taps_per_filter; j++) {
+	taps[j] = m[2*(taps_per_filter - 1 - j)];
       }
-      d_beta = beta;
+      return taps;
     }
 
-    /*******************************************************************
-     GET FUNCTIONS
-    *******************************************************************/
+    std::vector<float>
+    filter_bank::arm_diff_taps(int arm) const
+    {
+      const float *d = diff(arm);
+      std::vector<float> taps(taps_per_filter);
+      for(int j = 0; j < taps_per_filter; j++) {
+	taps[j] = d[2*(taps_per_filter - 1 - j)];
+      }
+      return taps;
+    }
 
-    float
-    my_pfb_clock_sync_impl::loop_bandwidth() const
+    // All arms in the layout of arm_taps(), nfilters*taps_per_filter
+    // values
+    void
+    filter_bank::copy_taps(float *out, bool derivative) const
     {
-      return d_loop_bw;
+      for(int i = 0; i < nfilters; i++) {
+	const float *h = derivative ? diff(i) : matched(i);
+	for(int j = 0; j < taps_per_filter; j++) {
+	  out[i*taps_per_filter + j] = h[2*(taps_per_filter - 1 - j)];
+	}
+      }
     }
 
-    float
-    my_pfb_clock_sync_impl::damping_factor() const
+    // Interleaves the arms back into the prototype, zero padded to
+    // nfilters*taps_per_filter, which partitions into the same arms
+    std::vector<float>
+    filter_bank::prototype() const
     {
-      return d_damping;
+      std::vector<float> taps(nfilters * taps_per_filter);
+      for(int i = 0; i < nfilters; i++) {
+	std::vector<float> arm = arm_taps(i);
+	for(int j = 0; j < taps_per_filter; j++) {
+	  taps[i + j*nfilters] = arm[j];
+	}
+      }
+      return taps;
     }
 
-    float
-    my_pfb_clock_sync_impl::alpha() const
+    // Dot product of the interleaved input with one duplicated tap set
+    static inline gr_complex
+    dot_prod(const float *x, const float *h, int n)
     {
-      return d_alpha;
+      int k = 0;
+      float re = 0, im = 0;
+#ifdef __SSE__
+      __m128 acc = _mm_setzero_ps();
+      for(; k + 4 <= n; k += 4) {
+	acc = _mm_add_ps(acc, _mm_mul_ps(_mm_loadu_ps(x + k), _mm_load_ps(h + k)));
+      }
+      float a[4];
+      _mm_storeu_ps(a, acc);
+      re = a[0] + a[2];
+      im = a[1] + a[3];
+#endif
+      for(; k < n; k += 2) {
+	re += x[k] * h[k];
+	im += x[k+1] * h[k+1];
+      }
+      return gr_complex(re, im);
     }
 
-    float
-    my_pfb_clock_sync_impl::beta() const
+    gr_complex
+    filter_bank::filter(int arm, const gr_complex *in) const
     {
-      return d_beta;
+      return dot_prod((const float*)in, matched(arm), 2*taps_per_filter);
     }
 
-    float
-    my_pfb_clock_sync_impl::clock_rate() const
+    gr_complex
+    filter_bank::filter_diff(int arm, const gr_complex *in) const
     {
-      return d_rate_f;
+      return dot_prod((const float*)in, diff(arm), 2*taps_per_filter);
     }
 
-    float
-    my_pfb_clock_sync_impl::error() const
+    // Matched and derivative output sharing each load of the input
+    void
+    filter_bank::filter_fused(int arm, const gr_complex *in,
+			      gr_complex &out, gr_complex &dout) const
     {
-      return d_error;
+      const float *x = (const float*)in;
+      const float *h = matched(arm);
+      const float *g = diff(arm);
+      const int n = 2*taps_per_filter;
+
+      int k = 0;
+      float re = 0, im = 0, dre = 0, dim = 0;
+#ifdef __SSE__
+      __m128 acc = _mm_setzero_ps();
+      __m128 dacc = _mm_setzero_ps();
+      for(; k + 4 <= n; k += 4) {
+	__m128 v = _mm_loadu_ps(x + k);
+	acc = _mm_add_ps(acc, _mm_mul_ps(v, _mm_load_ps(h + k)));
+	dacc = _mm_add_ps(dacc, _mm_mul_ps(v, _mm_load_ps(g + k)));
+      }
+      float a[4], b[4];
+      _mm_storeu_ps(a, acc);
+      _mm_storeu_ps(b, dacc);
+      re = a[0] + a[2];
+      im = a[1] + a[3];
+      dre = b[0] + b[2];
+      dim = b[1] + b[3];
+#endif
+      for(; k < n; k += 2) {
+	re += x[k] * h[k];
+	im += x[k+1] * h[k+1];
+	dre += x[k] * g[k];
+	dim += x[k+1] * g[k+1];
+      }
+      out = gr_complex(re, im);
+      dout = gr_complex(dre, dim);
     }
 
-    float
-    my_pfb_clock_sync_impl::rate() const
+    // Position of reversed tap p in the pair layout of the Q15 taps
+    static inline int
+    q15_index(int p)
     {
-      return d_rate_f;
+      return 8*(p >> 2) + (p & 1) + 4*((p >> 1) & 1);
     }
 
-    float
-    my_pfb_clock_sync_impl::phase() const
+    // Scale of the taps so a full scale input overflows neither the
+    // int16 taps nor the int32 accumulators
+    static float
+    q15_scale(const std::vector< std::vector<float> > &arms)
     {
-      return d_k;
+      float maxabs = 0, maxsum = 0;
+      int ntaps = 0;
+      for(unsigned int i = 0; i < arms.size(); i++) {
+	float sum = 0;
+	for(unsigned int j = 0; j < arms[i].size(); j++) {
+	  maxabs = std::max(maxabs, fabsf(arms[i][j]));
+	  sum += fabsf(arms[i][j]);
+	}
+	maxsum = std::max(maxsum, sum);
+	ntaps = arms[i].size();
+      }
+      if(maxabs == 0) {
+	return 1;
+      }
+      return std::min(32767.0f / maxabs, (65535.0f - ntaps) / maxsum);
     }
 
-    /*******************************************************************
-     *******************************************************************/
+    void
+    filter_bank::quantize()
+    {
+      std::vector< std::vector<float> > m(nfilters), d(nfilters);
+      for(int i = 0; i < nfilters; i++) {
+	m[i] = arm_taps(i);
+	d[i] = arm_diff_taps(i);
+      }
+      float mscale = q15_scale(m);
+      float dscale = q15_scale(d);
+
+      // 4 reversed taps per 8 shorts, for each filter of an arm
+      int nq = 2 * 4 * ((taps_per_filter + 3) / 4);
+      qstride = 2 * nq;
+      if(qcoeffs) {
+	volk_free(qcoeffs);
+      }
+      qcoeffs = (short*)volk_malloc(nfilters*qstride*sizeof(short), volk_get_alignment());
+      std::fill(qcoeffs, qcoeffs + nfilters*qstride, 0);
+
+      for(int i = 0; i < nfilters; i++) {
+	short *qm = qcoeffs + i*qstride;
+	short *qd = qm + nq;
+	for(int p = 0; p < taps_per_filter; p++) {
+	  int j = taps_per_filter - 1 - p;
+	  int idx = q15_index(p);
+	  qm[idx] = qm[idx+2] = (short)lrintf(m[i][j] * mscale);
+	  qd[idx] = qd[idx+2] = (short)lrintf(d[i][j] * dscale);
+	}
+      }
+
+      // Full scale sc16 is 32768, like the float conversion of sc16
+      qgain = 1.0f / (32768.0f * mscale);
+      qdgain = 1.0f / (32768.0f * dscale);
+    }
 
+    // filter_fused() on interleaved sc16 samples and the Q15 taps. The
+    // I and Q samples of 4 inputs are regrouped into pairs, so one
+    // _mm_madd_epi16 multiplies and adds 8 of them into int32 lanes.
     void
-    my_pfb_clock_sync_impl::update_gains()
+    filter_bank::filter_fused_q15(int arm, const short *in,
+				  gr_complex &out, gr_complex &dout) const
     {
-      float denom = (1.0 + 2.0*d_damping*d_loop_bw + d_loop_bw*d_loop_bw);
-      d_alpha = (4*d_damping*d_loop_bw) / denom;
-      d_beta = (4*d_loop_bw*d_loop_bw) / denom;
+      const short *h = qmatched(arm);
+      const short *g = qdiff(arm);
+
+      int p = 0;
+      int re = 0, im = 0, dre = 0, dim = 0;
+#ifdef __SSE2__
+      __m128i acc = _mm_setzero_si128();
+      __m128i dacc = _mm_setzero_si128();
+      for(; p + 4 <= taps_per_filter; p += 4) {
+	// I0 Q0 I1 Q1 I2 Q2 I3 Q3 -> I0 I1 Q0 Q1 I2 I3 Q2 Q3
+	__m128i v = _mm_loadu_si128((const __m128i*)(in + 2*p));
+	v = _mm_shufflelo_epi16(v, _MM_SHUFFLE(3, 1, 2, 0));
+	v = _mm_shufflehi_epi16(v, _MM_SHUFFLE(3, 1, 2, 0));
+	acc = _mm_add_epi32(acc, _mm_madd_epi16(v, _mm_load_si128((const __m128i*)(h + 2*p))));
+	dacc = _mm_add_epi32(dacc, _mm_madd_epi16(v, _mm_load_si128((const __m128i*)(g + 2*p))));
+      }
+      int a[4], b[4];
+      _mm_storeu_si128((__m128i*)a, acc);
+      _mm_storeu_si128((__m128i*)b, dacc);
+      re = a[0] + a[2];
+      im = a[1] + a[3];
+      dre = b[0] + b[2];
+      dim = b[1] + b[3];
+#endif
+      for(; p < taps_per_filter; p++) {
+	int idx = q15_index(p);
+	re += in[2*p] * h[idx];
+	im += in[2*p+1] * h[idx];
+	dre += in[2*p] * g[idx];
+	dim += in[2*p+1] * g[idx];
+      }
+      out = gr_complex(re * qgain, im * qgain);
+      dout = gr_complex(dre * qdgain, dim * qdgain);
     }
 
+    // INTERP_CUBIC: in[0] is the oldest of the four matched filter
+    // outputs, the output is located at mu between the second and third
     void
-    my_pfb_clock_sync_impl::set_taps(const std::vector<float> &newtaps,
-				      std::vector< std::vector<float> > &ourtaps,
-				      std::vector<kernel::fir_filter_ccf*> &ourfilter)
+    filter_bank::interpolate(const gr_complex *in, float mu,
+			     gr_complex &out, gr_complex &dout) const
+    {
+      gr_complex zm1 = filter(0, in);
+      gr_complex z0 = filter(0, in + 1);
+      gr_complex z1 = filter(0, in + 2);
+      gr_complex z2 = filter(0, in + 3);
+
+      // Farrow coefficients of the cubic Lagrange interpolator
+      gr_complex c1 = -zm1/3.0f - z0/2.0f + z1 - z2/6.0f;
+      gr_complex c2 = zm1/2.0f - z0 + z1/2.0f;
+      gr_complex c3 = -zm1/6.0f + z0/2.0f - z1/2.0f + z2/6.0f;
+
+      out = ((c3*mu + c2)*mu + c1)*mu + z0;
+      dout = ((3.0f*c3*mu + 2.0f*c2)*mu + c1) * dgain;
+    }
+
+    int
+    filter_bank::partition(int nfilters, const std::vector<float> &newtaps,
+			   std::vector< std::vector<float> > &ourtaps)
     {
       int i,j;
 
       unsigned int ntaps = newtaps.size();
-      d_taps_per_filter = (unsigned int)ceil((double)ntaps/(double)d_nfilters);
+      int taps_per_filter = (unsigned int)ceil((double)ntaps/(double)nfilters);
 
       // Create d_numchan vectors to store each channel's taps
-      ourtaps.resize(d_nfilters);
+      ourtaps.resize(nfilters);
 
       // Make a vector of the taps plus fill it out with 0's to fill
-      // each polyphase filter with exactly d_taps_per_filter
+      // each polyphase filter with exactly taps_per_filter
       std::vector<float> tmp_taps;
       tmp_taps = newtaps;
-      while((float)(tmp_taps.size()) < d_nfilters*d_taps_per_filter) {
+      while((float)(tmp_taps.size()) < nfilters*taps_per_filter) {
 	tmp_taps.push_back(0.0);
       }
 
       // Partition the filter
-      for(i = 0; i < d_nfilters; i++) {
-	// Each channel uses all d_taps_per_filter with 0's if not enough taps to fill out
-	ourtaps[i] = std::vector<float>(d_taps_per_filter, 0);
-	for(j = 0; j < d_taps_per_filter; j++) {
-	  ourtaps[i][j] = tmp_taps[i + j*d_nfilters];
+      for(i = 0; i < nfilters; i++) {
+	// Each channel uses all taps_per_filter with 0's if not enough taps to fill out
+	ourtaps[i] = std::vector<float>(taps_per_filter, 0);
+	for(j = 0; j < taps_per_filter; j++) {
+	  ourtaps[i][j] = tmp_taps[i + j*nfilters];
 	}
-
-	// Build a filter for each channel and add it's taps to it
-	ourfilter[i]->set_taps(ourtaps[i]);
       }
 
-      // Set the history to ensure enough input items for each filter
-      set_history(d_taps_per_filter + d_sps + d_sps);
-
-      // Make sure there is enough output space for d_osps outputs/input.
-      set_output_multiple(d_osps);
+      return taps_per_filter;
     }
 
     void
-    my_pfb_clock_sync_impl::create_diff_taps(const std::vector<float> &newtaps,
-					      std::vector<float> &difftaps)
+    filter_bank::diff_taps(int nfilters, const std::vector<float> &newtaps,
+			   std::vector<float> &difftaps)
     {
       std::vector<float> diff_filter(3);
       diff_filter[0] = -1;
@@ -300,7 +550,7 @@ namespace gr {
 
       // Normalize the taps
       for(unsigned int i = 0; i < difftaps.size(); i++) {
-        difftaps[i] *= d_nfilters/pwr;
+        difftaps[i] *= nfilters/pwr;
         if(difftaps[i] != difftaps[i]) {
           throw std::runtime_error("my_pfb_clock_sync::create_diff_taps produced NaN.");
         }
@@ -315,181 +565,1440 @@ namespace gr {
       str.precision(4);
       str.setf(std::ios::scientific);
 
+      std::vector< std::vector<float> > t = taps();
       str << "[ ";
-      for(i = 0; i < d_nfilters; i++) {
-	str << "[" << d_taps[i][0] << ", ";
+      for(i = 0; i < (int)t.size(); i++) {
+	str << "[" << t[i][0] << ", ";
 	for(j = 1; j < d_taps_per_filter-1; j++) {
-	  str << d_taps[i][j] << ", ";
+	  str << t[i][j] << ", ";
 	}
-	str << d_taps[i][j] << "],";
+	str << t[i][j] << "],";
       }
       str << " ]" << std::endl;
 
       return str.str();
     }
 
-    std::string
-    my_pfb_clock_sync_impl::diff_taps_as_string() const
+    filter_bank_sptr
+    filter_bank::make_pfb(int nfilters, const std::vector<float> &taps)
     {
-      int i, j;
-      std::stringstream str;
-      str.precision(4);
-      str.setf(std::ios::scientific);
+      std::vector<float> dtaps;
+      diff_taps(nfilters, taps, dtaps);
 
-      str << "[ ";
-      for(i = 0; i < d_nfilters; i++) {
-	str << "[" << d_dtaps[i][0] << ", ";
-	for(j = 1; j < d_taps_per_filter-1; j++) {
-	  str << d_dtaps[i][j] << ", ";
-	}
-	str << d_dtaps[i][j] << "],";
+      std::vector< std::vector<float> > ourtaps, ourdtaps;
+      int taps_per_filter = partition(nfilters, taps, ourtaps);
+      partition(nfilters, dtaps, ourdtaps);
+
+      filter_bank_sptr bank(new filter_bank(nfilters, taps_per_filter));
+      for(int i = 0; i < nfilters; i++) {
+	bank->set_arm(i, ourtaps[i], ourdtaps[i]);
       }
-      str << " ]" << std::endl;
 
-      return str.str();
+      return bank;
     }
 
-    std::vector< std::vector<float> >
-    my_pfb_clock_sync_impl::taps() const
+    bool
+    my_pfb_clock_sync_impl::check_topology(int ninputs, int noutputs)
     {
-      return d_taps;
+      select_kernels(noutputs == 4);
+      return noutputs == 1 || noutputs == 4;
     }
 
-    std::vector< std::vector<float> >
-    my_pfb_clock_sync_impl::diff_taps() const
+    void
+    my_pfb_clock_sync_impl::forecast(int noutput_items,
+                                      gr_vector_int &ninput_items_required)
     {
-      return d_dtaps;
+      int nsymbols = (noutput_items + d_osps - 1) / d_osps;
+      if(d_max_latency > 0) {
+	nsymbols = std::min(nsymbols, d_max_latency);
+      }
+
+      unsigned ninputs = ninput_items_required.size ();
+      for(unsigned i = 0; i < ninputs; i++)
+        ninput_items_required[i] = required_input(nsymbols);
     }
 
-    std::vector<float>
-    my_pfb_clock_sync_impl::channel_taps(int channel) const
+    // Input items read after the start of a symbol
+    int
+    my_pfb_clock_sync_impl::input_window() const
     {
-      std::vector<float> taps;
-      for(int i = 0; i < d_taps_per_filter; i++) {
-	taps.push_back(d_taps[channel][i]);
+      int window = d_taps_per_filter;
+      if(d_interp == INTERP_CUBIC) {
+	window += 3;
       }
-      return taps;
+      if(d_ted == TED_GARDNER) {
+	// matched output half a symbol ahead
+	window += (int)ceil(0.5 * d_last_sps) + 1;
+      }
+      return window;
     }
 
-    std::vector<float>
-    my_pfb_clock_sync_impl::diff_channel_taps(int channel) const
+    // Input items for nsymbols symbols from the current phase and
+    // rate, counted like ninput_items with the history in front.
+    // work_kernel stops on the same limits, so the first symbol is
+    // always produced.
+    int
+    my_pfb_clock_sync_impl::required_input(int nsymbols) const
     {
-      std::vector<float> taps;
-      for(int i = 0; i < d_taps_per_filter; i++) {
-	taps.push_back(d_dtaps[channel][i]);
-      }
-      return taps;
+      // Samples per symbol: floor(sps) plus the phase advance of the
+      // rate, with the loop correction bounded by the max deviation
+      double step = d_sps + (d_osps * (d_rate_i + d_max_dev) + d_sps * d_max_dev) / d_nfilters;
+      double last = floor(d_k / d_nfilters) + (nsymbols - 1) * step;
+
+      int nread = (int)ceil(last) + d_osps + input_window() + 2;
+      int nconsume = (int)ceil(last) + (int)d_sps + 2 + (int)history() - 1;
+      return std::max(nread, nconsume);
     }
 
     void
-    my_pfb_clock_sync_impl::set_sps(double sps)
+    my_pfb_clock_sync_impl::update_taps(const std::vector<float> &taps)
     {
-      d_last_sps = sps;
-      d_sps = floor(sps);
+      int ntaps = (d_interp == INTERP_CUBIC) ? taps.size() : (taps.size() + d_nfilters - 1) / d_nfilters;
+      if(!fits(ntaps, d_sps)) {
+	throw std::out_of_range("my_pfb_clock_sync: taps longer than the history reserved for them.");
+      }
 
-      d_rate = (sps-floor(sps))*(double)d_nfilters;
-      d_rate_i = (int)floor(d_rate);
-      d_rate_f = d_rate - (float)d_rate_i;
+      // Designed in the background, swapped in by general_work
+      post_design_job(0, taps);
+    }
 
-      // create new taps: rrc filter with new sps
-      d_updated_taps = filter::firdes::root_raised_cosine(d_nfilters, d_nfilters*sps, 1.0, 0.35, 45*d_nfilters);
-      std::vector<float> dtaps;
-      create_diff_taps(d_updated_taps, dtaps);
-      set_taps(d_updated_taps, d_taps, d_filters);
-      set_taps(dtaps, d_dtaps, d_diff_filters);
 
+    /*******************************************************************
+     SET FUNCTIONS
+    *******************************************************************/
+
+    void
+    my_pfb_clock_sync_impl::set_loop_bandwidth(float bw)
+    {
+      if(bw < 0) {
+	throw std::out_of_range("my_pfb_clock_sync: invalid bandwidth. Must be >= 0.");
+      }
 
-      set_relative_rate((float)d_osps/(float)d_sps);
+      gr::thread::scoped_lock lock(d_req_mutex);
+      d_req.loop_bw = bw;
+      d_req.update_gains();
+      publish_params();
     }
 
-    int
-    my_pfb_clock_sync_impl::general_work(int noutput_items,
-					  gr_vector_int &ninput_items,
-					  gr_vector_const_void_star &input_items,
-					  gr_vector_void_star &output_items)
+    void
+    my_pfb_clock_sync_impl::set_damping_factor(float df)
     {
-      gr_complex *in = (gr_complex *) input_items[0];
-      gr_complex *out = (gr_complex *) output_items[0];
+      if(df < 0 || df > 1.0) {
+	throw std::out_of_range("my_pfb_clock_sync: invalid damping factor. Must be in [0,1].");
+      }
 
-      std::vector<tag_t> tags;
-      get_tags_in_range(tags, 0, nitems_read(0), nitems_read(0) + d_det_block_size, pmt::intern("det_sps"));
+      gr::thread::scoped_lock lock(d_req_mutex);
+      d_req.damping = df;
+      d_req.update_gains();
+      d_req.update_acq_gains();
+      publish_params();
+    }
 
-      if(tags.size() != 0 && pmt::is_number(tags[0].value))
-      {
-        float new_sps = pmt::to_double(tags[0].value);
-        if( d_last_sps != new_sps && new_sps > 0 && new_sps < 50)
-        {
-          set_sps(new_sps);
-          return 0;
-        }
+    void
+    my_pfb_clock_sync_impl::set_alpha(float alpha)
+    {
+      if(alpha < 0 || alpha > 1.0) {
+	throw std::out_of_range("my_pfb_clock_sync: invalid alpha. Must be in [0,1].");
       }
+      gr::thread::scoped_lock lock(d_req_mutex);
+      d_req.alpha = alpha;
+      publish_params();
+    }
 
-      if(d_updated) {
-        std::vector<float> dtaps;
-        create_diff_taps(d_updated_taps, dtaps);
-        set_taps(d_updated_taps, d_taps, d_filters);
-        set_taps(dtaps, d_dtaps, d_diff_filters);
-	d_updated = false;
-	return 0;		     // history requirements may have changed.
+    void
+    my_pfb_clock_sync_impl::set_telemetry_decimation(int decim)
+    {
+      if(decim < 1) {
+	throw std::out_of_range("my_pfb_clock_sync: invalid telemetry decimation. Must be >= 1.");
       }
+      gr::thread::scoped_lock lock(d_req_mutex);
+      d_req.telem_decim = decim;
+      publish_params();
+    }
 
-      float *err = NULL, *outrate = NULL, *outk = NULL;
-      if(output_items.size() == 4) {
-	err = (float *) output_items[1];
-	outrate = (float*)output_items[2];
-	outk = (float*)output_items[3];
+    void
+    my_pfb_clock_sync_impl::set_acquisition_bandwidth(float bw)
+    {
+      if(bw < 0) {
+	throw std::out_of_range("my_pfb_clock_sync: invalid acquisition bandwidth. Must be >= 0.");
       }
 
-      tags.clear();
-      get_tags_in_range(tags, 0, nitems_read(0),
-                        nitems_read(0)+d_sps*noutput_items,
-                        pmt::intern("time_est"));
+      // Tracking gains set with set_alpha() and set_beta() are kept
+      gr::thread::scoped_lock lock(d_req_mutex);
+      d_req.acq_bw = bw;
+      d_req.update_acq_gains();
+      publish_params();
+    }
 
-      int i = 0, count = 0;
-      float error_r, error_i;
+    void
+    my_pfb_clock_sync_impl::set_lock_threshold(float th)
+    {
+      if(th <= 0) {
+	throw std::out_of_range("my_pfb_clock_sync: invalid lock threshold. Must be > 0.");
+      }
+      gr::thread::scoped_lock lock(d_req_mutex);
+      d_req.lock_th = th;
+      publish_params();
+    }
 
-      // produce output as long as we can and there are enough input samples
-      while(i < noutput_items) {
-        if(tags.size() > 0) {
-          size_t offset = tags[0].offset-nitems_read(0);
-          if((offset >= (size_t)count) && (offset < (size_t)(count + d_sps))) {
-            float center = (float)pmt::to_double(tags[0].value);
-            d_k = (offset-count - d_sps/2.0) * d_nfilters + (M_PI*center*d_nfilters);
-            tags.erase(tags.begin());
-          }
-        }
+    void
+    my_pfb_clock_sync_impl::set_matched_filter(float rolloff, float span, int window)
+    {
+      if(rolloff <= 0 || rolloff > 1) {
+	throw std::out_of_range("my_pfb_clock_sync: invalid roll-off. Must be in (0, 1].");
+      }
+      if(span < 0) {
+	throw std::out_of_range("my_pfb_clock_sync: invalid span. Must be >= 0.");
+      }
 
-	while(d_out_idx < d_osps) {
+      rrc_params rrc;
+      rrc.rolloff = rolloff;
+      rrc.span = span;
+      rrc.window = window;
 
-	  d_filtnum = (int)floor(d_k);
+      // d_requested_sps is changed by general_work
+      gr::thread::scoped_lock guard(d_setlock);
+      if(!fits(rrc.taps_per_filter(d_requested_sps), floor(d_requested_sps))) {
+	throw std::out_of_range("my_pfb_clock_sync: matched filter longer than the history reserved for it.");
+      }
 
-	  // Keep the current filter number in [0, d_nfilters]
-	  // If we've run beyond the last filter, wrap around and go to next sample
-	  // If we've gone below 0, wrap around and go to previous sample
-	  while(d_filtnum >= d_nfilters) {
-	    d_k -= d_nfilters;
-	    d_filtnum -= d_nfilters;
-	    count += 1;
-	  }
-	  while(d_filtnum < 0) {
-	    d_k += d_nfilters;
-	    d_filtnum += d_nfilters;
-	    count -= 1;
-	  }
+      {
+	gr::thread::scoped_lock lock(d_design_mutex);
+	d_rrc = rrc;
+	d_bank_cache.clear();
+      }
 
-	  out[i+d_out_idx] = d_filters[d_filtnum]->filter(&in[count+d_out_idx]);
-	  d_k = d_k + d_rate_i + d_rate_f; // update phase
-	  d_out_idx++;
+      // Redesign for the requested sps, swapped in by general_work
+      post_design_job(d_requested_sps, std::vector<float>());
+    }
 
-	  if(output_items.size() == 4) {
-	    err[i] = d_error;
-	    outrate[i] = d_rate_f;
-	    outk[i] = d_k;
-	  }
+    void
+    my_pfb_clock_sync_impl::set_matched_filter_preset(mf_preset preset)
+    {
+      float rolloff = current_rrc().rolloff;
+      switch(preset) {
+      case MF_LEGACY:
+	set_matched_filter(rolloff, 0, filter::firdes::WIN_NONE);
+	break;
+      case MF_ACCURATE:
+	set_matched_filter(rolloff, 12, filter::firdes::WIN_BLACKMAN_HARRIS);
+	break;
+      case MF_BALANCED:
+	set_matched_filter(rolloff, 8, filter::firdes::WIN_HAMMING);
+	break;
+      case MF_FAST:
+	set_matched_filter(rolloff, 6, filter::firdes::WIN_HAMMING);
+	break;
+      default:
+	throw std::out_of_range("my_pfb_clock_sync: invalid matched filter preset.");
+      }
+    }
+
+    void
+    my_pfb_clock_sync_impl::set_max_latency(int nsymbols)
+    {
+      if(nsymbols < 0) {
+	throw std::out_of_range("my_pfb_clock_sync: invalid maximum latency. Must be >= 0.");
+      }
+      gr::thread::scoped_lock lock(d_req_mutex);
+      d_req.max_latency = nsymbols;
+      publish_params();
+    }
+
+    // The statistics are updated by general_work under d_setlock
+    void
+    my_pfb_clock_sync_impl::reset_statistics()
+    {
+      gr::thread::scoped_lock guard(d_setlock);
+      d_error_stats.reset();
+      d_rate_stats.reset();
+    }
+
+    void
+    my_pfb_clock_sync_impl::reset_counters()
+    {
+      d_pc_symbols.reset();
+      d_pc_work_ns.reset();
+      d_pc_idle.reset();
+      d_pc_tags.reset();
+      d_pc_retunes.reset();
+      d_pc_designs.reset();
+      d_pc_design_ns.reset();
+    }
+
+    void
+    my_pfb_clock_sync_impl::set_loop_state(pmt::pmt_t state)
+    {
+      saved_state_sptr st(new saved_state);
+      std::string err = parse_state(state, *st);
+      if(!err.empty()) {
+	throw std::invalid_argument("my_pfb_clock_sync: bad loop state, " + err + ".");
+      }
+      restore_state(st);
+    }
+
+    // Message handlers run in the thread of general_work, which must
+    // not throw: bad states are reported and ignored
+    void
+    my_pfb_clock_sync_impl::handle_state(pmt::pmt_t msg)
+    {
+      bool is_state;
+      try {
+	is_state = pmt::is_dict(msg) && pmt::dict_has_key(msg, pmt::mp("sps"));
+      }
+      catch(pmt::exception &) {
+	// A pair that is no dict
+	is_state = false;
+      }
+
+      if(!is_state) {
+	message_port_pub(pmt::mp("state_out"), loop_state());
+	return;
+      }
+
+      saved_state_sptr st(new saved_state);
+      std::string err = parse_state(msg, *st);
+      if(!err.empty()) {
+	GR_LOG_WARN(d_logger, boost::format("bad loop state ignored, %1%") % err);
+	return;
+      }
+      restore_state(st);
+    }
+
+    static bool
+    is_scalar(pmt::pmt_t v)
+    {
+      return pmt::is_real(v) || pmt::is_integer(v);
+    }
+
+    // Checks the keys and types of a loop state dict. Returns why it
+    // cannot be restored, or an empty string.
+    std::string
+    my_pfb_clock_sync_impl::parse_state(pmt::pmt_t state, saved_state &st)
+    {
+      rrc_params rrc = current_rrc();
+
+      try {
+	if(!pmt::is_dict(state)) {
+	  return "not a dict";
+	}
+
+	pmt::pmt_t v = pmt::dict_ref(state, pmt::mp("sps"), pmt::PMT_NIL);
+	if(!is_scalar(v)) {
+	  return "\"sps\" missing or not a number";
+	}
+	st.sps = pmt::to_double(v);
+	if(!(st.sps >= 1 && st.sps < d_max_sps)) {
+	  return "\"sps\" out of range";
+	}
+	if(!fits(rrc.taps_per_filter(st.sps), floor(st.sps))) {
+	  return "\"sps\" needs more history than reserved";
+	}
+
+	v = pmt::dict_ref(state, pmt::mp("phase"), pmt::PMT_NIL);
+	st.has_phase = !pmt::is_null(v);
+	if(st.has_phase) {
+	  if(!is_scalar(v)) {
+	    return "\"phase\" not a number";
+	  }
+	  st.phase = pmt::to_double(v);
+	  if(!(std::fabs(st.phase) < 2 * d_nfilters)) {
+	    return "\"phase\" out of range";
+	  }
+	}
+
+	v = pmt::dict_ref(state, pmt::mp("rate"), pmt::PMT_NIL);
+	st.has_rate = !pmt::is_null(v);
+	if(st.has_rate) {
+	  if(!is_scalar(v)) {
+	    return "\"rate\" not a number";
+	  }
+	  st.rate = pmt::to_double(v);
+	  if(!(std::fabs(st.rate) < d_nfilters)) {
+	    return "\"rate\" out of range";
+	  }
+	}
+
+	v = pmt::dict_ref(state, pmt::mp("locked"), pmt::PMT_F);
+	if(!pmt::is_bool(v)) {
+	  return "\"locked\" not a bool";
+	}
+	st.locked = pmt::to_bool(v);
+
+	// Use the saved taps if they fit this block, else the bank of the sps
+	int nfilters = (d_interp == INTERP_CUBIC) ? 1 : d_nfilters;
+	pmt::pmt_t taps = pmt::dict_ref(state, pmt::mp("taps"), pmt::PMT_NIL);
+	pmt::pmt_t nf = pmt::dict_ref(state, pmt::mp("nfilters"), pmt::PMT_NIL);
+	st.taps.clear();
+	if(pmt::is_f32vector(taps) && pmt::is_integer(nf) && pmt::to_long(nf) == nfilters) {
+	  st.taps = pmt::f32vector_elements(taps);
+	  int ntaps = (st.taps.size() + nfilters - 1) / nfilters;
+	  if(st.taps.empty() || !fits(ntaps, floor(st.sps))) {
+	    return "\"taps\" longer than the history reserved for them";
+	  }
+	}
+      }
+      catch(pmt::exception &e) {
+	return e.what();
+      }
+      return "";
+    }
+
+    // A cached bank is swapped in right away, otherwise the state goes
+    // with a design job and swap_pending_bank() restores it
+    void
+    my_pfb_clock_sync_impl::restore_state(saved_state_sptr st)
+    {
+      gr::thread::scoped_lock guard(d_setlock);
+      d_requested_sps = st->sps;
+
+      if(!st->taps.empty()) {
+	post_design_job(0, st->taps, st);
+	return;
+      }
+
+      long key = boost::math::lround(st->sps * d_sps_quant);
+      filter_bank_sptr bank = find_cached_bank(key);
+      if(bank) {
+	cancel_design_jobs();
+	apply_state(*st, bank);
+      }
+      else {
+	post_design_job(st->sps, std::vector<float>(), st);
+      }
+    }
+
+    void
+    my_pfb_clock_sync_impl::apply_state(const saved_state &st, filter_bank_sptr bank)
+    {
+      apply_sps(st.sps, bank);
+      if(st.has_phase) {
+	d_k = st.phase;
+	d_filtnum = (int)floor(d_k);
+      }
+      if(st.has_rate) {
+	d_rate_f = st.rate;
+      }
+      d_out_idx = 0;
+
+      // apply_sps started acquisition, resume tracking if saved locked
+      if(st.locked) {
+	d_locked = true;
+	d_lock_avg = 0;
+	d_lock_count = 0;
+	apply_gains();
+      }
+    }
+
+    pmt::pmt_t
+    my_pfb_clock_sync_impl::loop_state() const
+    {
+      gr::thread::scoped_lock guard(setlock());
+      std::vector<float> taps = d_bank->prototype();
+
+      pmt::pmt_t state = pmt::make_dict();
+      state = pmt::dict_add(state, pmt::mp("sps"), pmt::from_double(d_last_sps));
+      state = pmt::dict_add(state, pmt::mp("phase"), pmt::from_float(d_k));
+      state = pmt::dict_add(state, pmt::mp("rate"), pmt::from_float(d_rate_f));
+      state = pmt::dict_add(state, pmt::mp("locked"), pmt::from_bool(d_locked));
+      state = pmt::dict_add(state, pmt::mp("nfilters"), pmt::from_long(d_bank->nfilters));
+      state = pmt::dict_add(state, pmt::mp("taps"), pmt::init_f32vector(taps.size(), taps));
+      return state;
+    }
+
+    void
+    my_pfb_clock_sync_impl::set_beta(float beta)
+    {
+      if(beta < 0 || beta > 1.0) {
+	throw std::out_of_range("my_pfb_clock_sync: invalid beta. Must be in [0,1].");
+      }
+      gr::thread::scoped_lock lock(d_req_mutex);
+      d_req.beta = beta;
+      publish_params();
+    }
+
+    void
+    my_pfb_clock_sync_impl::set_max_rate_deviation(float m)
+    {
+      gr::thread::scoped_lock lock(d_req_mutex);
+      d_req.max_dev = m;
+      publish_params();
+    }
+
+    /*******************************************************************
+     GET FUNCTIONS
+    *******************************************************************/
+
+    float
+    my_pfb_clock_sync_impl::loop_bandwidth() const
+    {
+      gr::thread::scoped_lock lock(d_req_mutex);
+      return d_req.loop_bw;
+    }
+
+    float
+    my_pfb_clock_sync_impl::damping_factor() const
+    {
+      gr::thread::scoped_lock lock(d_req_mutex);
+      return d_req.damping;
+    }
+
+    float
+    my_pfb_clock_sync_impl::alpha() const
+    {
+      gr::thread::scoped_lock lock(d_req_mutex);
+      return d_req.alpha;
+    }
+
+    float
+    my_pfb_clock_sync_impl::beta() const
+    {
+      gr::thread::scoped_lock lock(d_req_mutex);
+      return d_req.beta;
+    }
+
+    float
+    my_pfb_clock_sync_impl::clock_rate() const
+    {
+      return d_rate_f;
+    }
+
+    float
+    my_pfb_clock_sync_impl::error() const
+    {
+      return d_error;
+    }
+
+    float
+    my_pfb_clock_sync_impl::rate() const
+    {
+      return d_rate_f;
+    }
+
+    float
+    my_pfb_clock_sync_impl::phase() const
+    {
+      return d_k;
+    }
+
+    int
+    my_pfb_clock_sync_impl::telemetry_decimation() const
+    {
+      gr::thread::scoped_lock lock(d_req_mutex);
+      return d_req.telem_decim;
+    }
+
+    int
+    my_pfb_clock_sync_impl::max_latency() const
+    {
+      gr::thread::scoped_lock lock(d_req_mutex);
+      return d_req.max_latency;
+    }
+
+    float
+    my_pfb_clock_sync_impl::rolloff() const
+    {
+      return current_rrc().rolloff;
+    }
+
+    float
+    my_pfb_clock_sync_impl::span() const
+    {
+      return current_rrc().span;
+    }
+
+    int
+    my_pfb_clock_sync_impl::window() const
+    {
+      return current_rrc().window;
+    }
+
+    float
+    my_pfb_clock_sync_impl::acquisition_bandwidth() const
+    {
+      gr::thread::scoped_lock lock(d_req_mutex);
+      return d_req.acq_bw;
+    }
+
+    float
+    my_pfb_clock_sync_impl::lock_threshold() const
+    {
+      gr::thread::scoped_lock lock(d_req_mutex);
+      return d_req.lock_th;
+    }
+
+    bool
+    my_pfb_clock_sync_impl::locked() const
+    {
+      return d_locked;
+    }
+
+    float
+    my_pfb_clock_sync_impl::error_mean() const
+    {
+      gr::thread::scoped_lock guard(setlock());
+      return d_error_stats.mean();
+    }
+
+    float
+    my_pfb_clock_sync_impl::error_variance() const
+    {
+      gr::thread::scoped_lock guard(setlock());
+      return d_error_stats.variance();
+    }
+
+    float
+    my_pfb_clock_sync_impl::rate_mean() const
+    {
+      gr::thread::scoped_lock guard(setlock());
+      return d_rate_stats.mean();
+    }
+
+    float
+    my_pfb_clock_sync_impl::rate_variance() const
+    {
+      gr::thread::scoped_lock guard(setlock());
+      return d_rate_stats.variance();
+    }
+
+    std::vector<float>
+    my_pfb_clock_sync_impl::error_histogram() const
+    {
+      gr::thread::scoped_lock guard(setlock());
+      return d_error_stats.hist;
+    }
+
+    std::vector<float>
+    my_pfb_clock_sync_impl::rate_histogram() const
+    {
+      gr::thread::scoped_lock guard(setlock());
+      return d_rate_stats.hist;
+    }
+
+    uint64_t
+    my_pfb_clock_sync_impl::symbols_produced() const
+    {
+      return d_pc_symbols.value();
+    }
+
+    double
+    my_pfb_clock_sync_impl::work_time() const
+    {
+      return d_pc_work_ns.seconds();
+    }
+
+    uint64_t
+    my_pfb_clock_sync_impl::zero_output_calls() const
+    {
+      return d_pc_idle.value();
+    }
+
+    uint64_t
+    my_pfb_clock_sync_impl::retunes() const
+    {
+      return d_pc_retunes.value();
+    }
+
+    uint64_t
+    my_pfb_clock_sync_impl::banks_designed() const
+    {
+      return d_pc_designs.value();
+    }
+
+    double
+    my_pfb_clock_sync_impl::design_time() const
+    {
+      return d_pc_design_ns.seconds();
+    }
+
+    uint64_t
+    my_pfb_clock_sync_impl::tags_emitted() const
+    {
+      return d_pc_tags.value();
+    }
+
+    /*******************************************************************
+     *******************************************************************/
+
+    void
+    loop_params::update_gains()
+    {
+      float denom = (1.0 + 2.0*damping*loop_bw + loop_bw*loop_bw);
+      alpha = (4*damping*loop_bw) / denom;
+      beta = (4*loop_bw*loop_bw) / denom;
+    }
+
+    void
+    loop_params::update_acq_gains()
+    {
+      float denom = (1.0 + 2.0*damping*acq_bw + acq_bw*acq_bw);
+      acq_alpha = (4*damping*acq_bw) / denom;
+      acq_beta = (4*acq_bw*acq_bw) / denom;
+    }
+
+    void
+    my_pfb_clock_sync_impl::update_gains()
+    {
+      gr::thread::scoped_lock lock(d_req_mutex);
+      d_req.update_gains();
+      d_req.update_acq_gains();
+      publish_params();
+    }
+
+    // Callers hold d_req_mutex. A copy not yet taken by the streaming
+    // thread is replaced, only the latest parameters matter.
+    void
+    my_pfb_clock_sync_impl::publish_params()
+    {
+      loop_params *p = new loop_params(d_req);
+      delete d_mailbox.exchange(p, boost::memory_order_acq_rel);
+    }
+
+    // Streaming thread, at a symbol boundary
+    void
+    my_pfb_clock_sync_impl::take_params()
+    {
+      loop_params *p = d_mailbox.exchange(NULL, boost::memory_order_acq_rel);
+      if(!p) {
+	return;
+      }
+
+      d_loop_bw = p->loop_bw;
+      d_damping = p->damping;
+      d_alpha = p->alpha;
+      d_beta = p->beta;
+      d_acq_bw = p->acq_bw;
+      d_acq_alpha = p->acq_alpha;
+      d_acq_beta = p->acq_beta;
+      d_lock_th = p->lock_th;
+      d_telem_decim = p->telem_decim;
+      d_max_latency = p->max_latency;
+      if(d_max_dev != p->max_dev) {
+	d_max_dev = p->max_dev;
+	d_rate_stats.set_range(d_max_dev);
+      }
+      delete p;
+
+      apply_gains();
+    }
+
+    // Selects the gains for the current lock state
+    void
+    my_pfb_clock_sync_impl::apply_gains()
+    {
+      if(d_acq_bw > 0 && !d_locked) {
+	d_gain_alpha = d_acq_alpha;
+	d_gain_beta = d_acq_beta;
+      }
+      else {
+	d_gain_alpha = d_alpha;
+	d_gain_beta = d_beta;
+      }
+    }
+
+    // Start over with acquisition, on retunes and "time_est" tags
+    void
+    my_pfb_clock_sync_impl::reset_lock()
+    {
+      d_locked = false;
+      d_lock_avg = 1;
+      d_lock_count = 0;
+      apply_gains();
+    }
+
+    // Lock detection on the squared timing error averaged over about
+    // 64 symbols, with hysteresis between locking and unlocking
+    void
+    my_pfb_clock_sync_impl::update_lock(int out_idx)
+    {
+      const float g = 1.0 / 64;
+      d_lock_avg = (1 - g) * d_lock_avg + g * d_error * d_error;
+      d_lock_count++;
+
+      bool locked = d_locked;
+      if(!d_locked && d_lock_count >= 64 && d_lock_avg < d_lock_th) {
+	locked = true;
+      }
+      else if(d_locked && d_lock_avg > 2 * d_lock_th) {
+	locked = false;
+      }
+
+      if(locked != d_locked) {
+	d_locked = locked;
+	apply_gains();
+	add_item_tag(0, nitems_written(0) + out_idx,
+		     pmt::intern("clock_lock"), pmt::from_bool(d_locked));
+	d_pc_tags.add();
+      }
+    }
+
+    void
+    my_pfb_clock_sync_impl::set_taps(const std::vector<float> &newtaps,
+				      std::vector< std::vector<float> > &ourtaps,
+				      std::vector<kernel::fir_filter_ccf*> &ourfilter)
+    {
+      int ntaps = partition_taps(newtaps, ourtaps);
+      for(int i = 0; i < d_nfilters; i++) {
+	ourfilter[i]->set_taps(ourtaps[i]);
+      }
+
+      // The bank of the block is replaced like by update_taps(), the
+      // history and the running filter stay untouched until then
+      if(!fits(ntaps, d_sps)) {
+	throw std::out_of_range("my_pfb_clock_sync: taps longer than the history reserved for them.");
+      }
+      post_design_job(0, newtaps);
+    }
+
+    // Does not touch the block state, also called from the design thread
+    int
+    my_pfb_clock_sync_impl::partition_taps(const std::vector<float> &newtaps,
+					    std::vector< std::vector<float> > &ourtaps) const
+    {
+      return filter_bank::partition(d_nfilters, newtaps, ourtaps);
+    }
+
+    void
+    my_pfb_clock_sync_impl::create_diff_taps(const std::vector<float> &newtaps,
+					      std::vector<float> &difftaps) const
+    {
+      filter_bank::diff_taps(d_nfilters, newtaps, difftaps);
+    }
+
+    std::string
+    my_pfb_clock_sync_impl::diff_taps_as_string() const
+    {
+      int i, j;
+      std::stringstream str;
+      str.precision(4);
+      str.setf(std::ios::scientific);
+
+      std::vector< std::vector<float> > t = diff_taps();
+      str << "[ ";
+      for(i = 0; i < (int)t.size(); i++) {
+	str << "[" << t[i][0] << ", ";
+	for(j = 1; j < d_taps_per_filter-1; j++) {
+	  str << t[i][j] << ", ";
+	}
+	str << t[i][j] << "],";
+      }
+      str << " ]" << std::endl;
+
+      return str.str();
+    }
+
+    std::vector< std::vector<float> >
+    my_pfb_clock_sync_impl::taps() const
+    {
+      gr::thread::scoped_lock guard(setlock());
+      std::vector< std::vector<float> > taps(d_bank->nfilters);
+      for(int i = 0; i < d_bank->nfilters; i++) {
+	taps[i] = d_bank->arm_taps(i);
+      }
+      return taps;
+    }
+
+    std::vector< std::vector<float> >
+    my_pfb_clock_sync_impl::diff_taps() const
+    {
+      gr::thread::scoped_lock guard(setlock());
+      std::vector< std::vector<float> > taps(d_bank->nfilters);
+      for(int i = 0; i < d_bank->nfilters; i++) {
+	taps[i] = d_bank->arm_diff_taps(i);
+      }
+      return taps;
+    }
+
+    std::vector<int>
+    my_pfb_clock_sync_impl::taps_shape() const
+    {
+      gr::thread::scoped_lock guard(setlock());
+      std::vector<int> shape(2);
+      shape[0] = d_bank->nfilters;
+      shape[1] = d_bank->taps_per_filter;
+      return shape;
+    }
+
+    // The lock keeps general_work from swapping the bank while copying,
+    // the getters above take it as well
+    size_t
+    my_pfb_clock_sync_impl::taps_into(float *out, size_t max)
+    {
+      gr::thread::scoped_lock guard(d_setlock);
+      size_t n = d_bank->nfilters * d_bank->taps_per_filter;
+      if(n <= max) {
+	d_bank->copy_taps(out, false);
+      }
+      return n;
+    }
+
+    size_t
+    my_pfb_clock_sync_impl::diff_taps_into(float *out, size_t max)
+    {
+      gr::thread::scoped_lock guard(d_setlock);
+      size_t n = d_bank->nfilters * d_bank->taps_per_filter;
+      if(n <= max) {
+	d_bank->copy_taps(out, true);
+      }
+      return n;
+    }
+
+    std::vector<float>
+    my_pfb_clock_sync_impl::channel_taps(int channel) const
+    {
+      gr::thread::scoped_lock guard(setlock());
+      return d_bank->arm_taps(channel);
+    }
+
+    std::vector<float>
+    my_pfb_clock_sync_impl::diff_channel_taps(int channel) const
+    {
+      gr::thread::scoped_lock guard(setlock());
+      return d_bank->arm_diff_taps(channel);
+    }
+
+    void
+    my_pfb_clock_sync_impl::set_sps(double sps)
+    {
+      rrc_params rrc = current_rrc();
+      if(!fits(rrc.taps_per_filter(sps), floor(sps))) {
+	throw std::out_of_range("my_pfb_clock_sync: sps too large for the reserved history.");
+      }
+
+      gr::thread::scoped_lock guard(d_setlock);
+      long key = boost::math::lround(sps * d_sps_quant);
+
+      // rrc filterbanks for the new sps, designed only on a cache miss
+      filter_bank_sptr bank = find_cached_bank(key);
+      if(!bank) {
+	bank = design_rrc_bank(key, rrc);
+	cache_bank(key, bank);
+      }
+      d_requested_sps = sps;
+      cancel_design_jobs();
+      apply_sps(sps, bank);
+    }
+
+    // Called on "det_sps" tags: a cached bank is used right away,
+    // otherwise it is designed in the background and the loop keeps
+    // running with the current sps until the bank is swapped in.
+    void
+    my_pfb_clock_sync_impl::request_sps(double sps)
+    {
+      if(!fits(current_rrc().taps_per_filter(sps), floor(sps))) {
+	if(sps != d_rejected_sps) {
+	  GR_LOG_WARN(d_logger, boost::format("sps %1% needs more history than reserved, ignored") % sps);
+	  d_rejected_sps = sps;
+	}
+	return;
+      }
+      d_requested_sps = sps;
+
+      long key = boost::math::lround(sps * d_sps_quant);
+      filter_bank_sptr bank = find_cached_bank(key);
+      if(bank) {
+	cancel_design_jobs();
+	apply_sps(sps, bank);
+      }
+      else {
+	post_design_job(sps, std::vector<float>());
+      }
+    }
+
+    // Outdates any design still running for an older request
+    void
+    my_pfb_clock_sync_impl::cancel_design_jobs()
+    {
+      gr::thread::scoped_lock lock(d_design_mutex);
+      d_design_gen++;
+      d_job_pending = false;
+      d_pending_bank.reset();
+      d_pending_state.reset();
+    }
+
+    void
+    my_pfb_clock_sync_impl::apply_sps(double sps, filter_bank_sptr bank)
+    {
+      d_last_sps = sps;
+      d_sps = floor(sps);
+
+      d_rate = (sps-floor(sps))*(double)d_nfilters;
+      d_rate_i = (int)floor(d_rate);
+      d_rate_f = d_rate - (float)d_rate_i;
+
+      set_bank(bank);
+      reset_lock();
+      d_pc_retunes.add();
+
+      set_relative_rate((float)d_osps/(float)d_sps);
+    }
+
+    filter_bank_sptr
+    my_pfb_clock_sync_impl::design_bank(const std::vector<float> &newtaps) const
+    {
+      perf_timer timer(d_pc_design_ns);
+      d_pc_designs.add();
+
+      if(d_interp == INTERP_CUBIC) {
+	return design_cubic_bank(newtaps);
+      }
+
+      return filter_bank::make_pfb(d_nfilters, newtaps);
+    }
+
+    // The taps of INTERP_CUBIC are the matched filter at the input rate
+    filter_bank_sptr
+    my_pfb_clock_sync_impl::design_cubic_bank(const std::vector<float> &newtaps) const
+    {
+      filter_bank_sptr bank(new filter_bank(1, newtaps.size()));
+      bank->set_arm(0, newtaps, std::vector<float>(newtaps.size(), 0));
+
+      // Scale the derivative like the normalized derivative filterbank,
+      // by the total variation of the taps
+      float pwr = 0;
+      for(unsigned int i = 1; i < newtaps.size(); i++) {
+	pwr += fabsf(newtaps[i] - newtaps[i-1]);
+      }
+      if(pwr > 0) {
+	bank->dgain = 1.0 / pwr;
+      }
+
+      return bank;
+    }
+
+    int
+    rrc_params::taps_per_filter(double sps) const
+    {
+      if(span <= 0) {
+	return legacy_taps;
+      }
+      return std::max(3, (int)ceil(span * sps));
+    }
+
+    // Prototype for a bank of nfilters arms, 1 for the input rate filter
+    std::vector<float>
+    rrc_params::prototype(int nfilters, double sps) const
+    {
+      std::vector<float> taps =
+	filter::firdes::root_raised_cosine(nfilters, nfilters*sps, 1.0, rolloff,
+					   taps_per_filter(sps)*nfilters);
+
+      // Window the truncated prototype and restore its gain
+      if(window != filter::firdes::WIN_NONE) {
+	std::vector<float> win = filter::firdes::window((filter::firdes::win_type)window,
+							 taps.size(), 6.76);
+	float before = 0, after = 0;
+	for(unsigned int i = 0; i < taps.size(); i++) {
+	  before += taps[i];
+	  taps[i] *= win[i];
+	  after += taps[i];
+	}
+	if(after != 0) {
+	  for(unsigned int i = 0; i < taps.size(); i++) {
+	    taps[i] *= before / after;
+	  }
+	}
+      }
+
+      return taps;
+    }
+
+    filter_bank_sptr
+    my_pfb_clock_sync_impl::design_rrc_bank(long key, const rrc_params &p) const
+    {
+      // create new taps: rrc filter with the quantized sps
+      double qsps = (double)key / (double)d_sps_quant;
+      int nfilters = (d_interp == INTERP_CUBIC) ? 1 : d_nfilters;
+      return design_bank(p.prototype(nfilters, qsps));
+    }
+
+    unsigned int
+    my_pfb_clock_sync_impl::required_history(int taps_per_filter, double sps) const
+    {
+      // The cubic interpolator reads three matched filter outputs ahead
+      unsigned int extra = (d_interp == INTERP_CUBIC) ? 3 : 0;
+      return taps_per_filter + sps + sps + extra;
+    }
+
+    // Whether a bank of taps_per_filter taps runs at sps within the
+    // history reserved by the constructor
+    bool
+    my_pfb_clock_sync_impl::fits(int taps_per_filter, double sps) const
+    {
+      return required_history(taps_per_filter, sps) <= history();
+    }
+
+    // The matched filter as last set, for callers in any thread
+    rrc_params
+    my_pfb_clock_sync_impl::current_rrc() const
+    {
+      gr::thread::scoped_lock lock(d_design_mutex);
+      return d_rrc;
+    }
+
+    filter_bank_sptr
+    my_pfb_clock_sync_impl::find_cached_bank(long key)
+    {
+      gr::thread::scoped_lock lock(d_design_mutex);
+
+      std::list< std::pair<long, filter_bank_sptr> >::iterator it;
+      for(it = d_bank_cache.begin(); it != d_bank_cache.end(); it++) {
+	if(it->first == key) {
+	  // Move to the front, it is now the most recently used
+	  d_bank_cache.splice(d_bank_cache.begin(), d_bank_cache, it);
+	  return d_bank_cache.front().second;
+	}
+      }
+      return filter_bank_sptr();
+    }
+
+    void
+    my_pfb_clock_sync_impl::cache_bank(long key, filter_bank_sptr bank)
+    {
+      gr::thread::scoped_lock lock(d_design_mutex);
+      insert_cached_bank(key, bank);
+    }
+
+    // Callers hold d_design_mutex
+    void
+    my_pfb_clock_sync_impl::insert_cached_bank(long key, filter_bank_sptr bank)
+    {
+      d_bank_cache.push_front(std::make_pair(key, bank));
+      if(d_bank_cache.size() > d_bank_cache_size) {
+	d_bank_cache.pop_back();
+      }
+    }
+
+    // Callers check fits() first, the history is fixed while running
+    void
+    my_pfb_clock_sync_impl::set_bank(filter_bank_sptr bank)
+    {
+      if(!fits(bank->taps_per_filter, d_sps)) {
+	throw std::logic_error("my_pfb_clock_sync: filterbank longer than the history.");
+      }
+      d_bank = bank;
+      d_taps_per_filter = bank->taps_per_filter;
+
+      // Make sure there is enough output space for d_osps outputs/input.
+      set_output_multiple(d_osps);
+    }
+
+    void
+    my_pfb_clock_sync_impl::post_design_job(double sps, const std::vector<float> &taps,
+					     saved_state_sptr state)
+    {
+      gr::thread::scoped_lock lock(d_design_mutex);
+
+      // Only the latest request is of interest
+      d_design_gen++;
+      d_job_sps = sps;
+      d_job_taps = taps;
+      d_job_rrc = d_rrc;
+      d_job_state = state;
+      d_job_pending = true;
+      d_design_cond.notify_one();
+    }
+
+    void
+    my_pfb_clock_sync_impl::swap_pending_bank()
+    {
+      filter_bank_sptr bank;
+      saved_state_sptr state;
+      double sps;
+      {
+	// Never wait for a caller posting a job, try again next call
+	gr::thread::scoped_lock lock(d_design_mutex, boost::try_to_lock);
+	if(!lock.owns_lock() || !d_pending_bank) {
+	  return;
+	}
+	bank.swap(d_pending_bank);
+	state.swap(d_pending_state);
+	sps = d_pending_sps;
+	if(d_pending_gen != d_design_gen) {
+	  return;
+	}
+      }
+
+      // The sps or the history may have changed since the job was posted
+      if(state) {
+	sps = state->sps;
+      }
+      double new_sps = (sps > 0) ? floor(sps) : d_sps;
+      if(!fits(bank->taps_per_filter, new_sps)) {
+	GR_LOG_WARN(d_logger, "designed filterbank needs more history than reserved, dropped");
+	return;
+      }
+
+      if(state) {
+	apply_state(*state, bank);
+      }
+      else if(sps > 0) {
+	apply_sps(sps, bank);
+      }
+      else {
+	set_bank(bank);
+      }
+    }
+
+    void
+    my_pfb_clock_sync_impl::design_thread()
+    {
+      while(true) {
+	double sps;
+	unsigned long gen;
+	std::vector<float> taps;
+	rrc_params rrc;
+	saved_state_sptr state;
+	{
+	  gr::thread::scoped_lock lock(d_design_mutex);
+	  while(!d_job_pending && !d_design_stop) {
+	    d_design_cond.wait(lock);
+	  }
+	  if(d_design_stop) {
+	    return;
+	  }
+	  sps = d_job_sps;
+	  gen = d_design_gen;
+	  taps.swap(d_job_taps);
+	  rrc = d_job_rrc;
+	  state.swap(d_job_state);
+	  d_job_pending = false;
+	}
+
+	filter_bank_sptr bank;
+	long key = 0;
+	if(sps > 0) {
+	  key = boost::math::lround(sps * d_sps_quant);
+	  bank = design_rrc_bank(key, rrc);
+	}
+	else {
+	  // User supplied prototype, not part of the sps cache
+	  bank = design_bank(taps);
+	}
+
+	// Banks of outdated jobs may be for a matched filter that
+	// was changed since, so they are neither cached nor used
+	gr::thread::scoped_lock lock(d_design_mutex);
+	if(gen == d_design_gen) {
+	  if(sps > 0) {
+	    insert_cached_bank(key, bank);
+	  }
+	  d_pending_bank = bank;
+	  d_pending_sps = sps;
+	  d_pending_state = state;
+	  d_pending_gen = gen;
+	}
+      }
+    }
+
+    int
+    my_pfb_clock_sync_impl::general_work(int noutput_items,
+					  gr_vector_int &ninput_items,
+					  gr_vector_const_void_star &input_items,
+					  gr_vector_void_star &output_items)
+    {
+      gr_complex *in = (gr_complex *) input_items[0];
+      gr_complex *out = (gr_complex *) output_items[0];
+
+      // Parameters published since the last call, unless the last
+      // symbol is not fully written yet
+      if(d_out_idx == 0 && d_mailbox.load(boost::memory_order_relaxed)) {
+	take_params();
+      }
+
+      if(d_max_latency > 0) {
+	noutput_items = std::min(noutput_items, d_max_latency * d_osps);
+      }
+
+      // A "det_sps" tag applies from the symbol centered on it: in[0] is
+      // history()-1 items before nitems_read(0), the next symbol is
+      // centered about half a filter later
+      int64_t center = (int64_t)nitems_read(0) - (int64_t)history() + 1 + d_taps_per_filter/2;
+      center = std::max<int64_t>(center, 0);
+
+      std::vector<tag_t> tags;
+      get_tags_in_range(tags, 0, center, center + d_det_block_size, pmt::intern("det_sps"));
+
+      if(tags.size() != 0 && pmt::is_number(tags[0].value))
+      {
+        float new_sps = pmt::to_double(tags[0].value);
+        if( d_requested_sps != new_sps && new_sps > 0 && new_sps < d_max_sps)
+        {
+          request_sps(new_sps);
+        }
+      }
+
+      // Swap in banks finished by the design thread, we are at a symbol boundary
+      if(d_out_idx == 0) {
+        swap_pending_bank();
+      }
+
+      float *err = NULL, *outrate = NULL, *outk = NULL;
+      if(output_items.size() == 4) {
+	err = (float *) output_items[1];
+	outrate = (float*)output_items[2];
+	outk = (float*)output_items[3];
+      }
+
+      tags.clear();
+      get_tags_in_range(tags, 0, nitems_read(0),
+                        nitems_read(0)+d_sps*noutput_items,
+                        pmt::intern("time_est"));
+
+      int count = 0, ntelem = 0;
+      int i;
+      {
+	perf_timer timer(d_pc_work_ns);
+	i = (this->*d_kernels[!tags.empty()])(noutput_items, in, out,
+					      err, outrate, outk,
+					      tags, ninput_items[0],
+					      count, ntelem);
+      }
+      d_pc_symbols.add(i);
+      if(i == 0) {
+	d_pc_idle.add();
+      }
+
+      consume_each(count);
+
+      // The telemetry outputs run at their own, decimated rate
+      if(output_items.size() == 4) {
+	produce(0, i);
+	for(int n = 1; n < 4; n++) {
+	  produce(n, ntelem);
+	}
+	return WORK_CALLED_PRODUCE;
+      }
+      return i;
+    }
+
+    // Called whenever the osps or the number of connected outputs change
+    void
+    my_pfb_clock_sync_impl::select_kernels(bool telemetry)
+    {
+      if(d_osps == 1) {
+	if(telemetry) {
+	  d_kernels[0] = &my_pfb_clock_sync_impl::work_kernel<1, true, false>;
+	  d_kernels[1] = &my_pfb_clock_sync_impl::work_kernel<1, true, true>;
+	}
+	else {
+	  d_kernels[0] = &my_pfb_clock_sync_impl::work_kernel<1, false, false>;
+	  d_kernels[1] = &my_pfb_clock_sync_impl::work_kernel<1, false, true>;
+	}
+      }
+      else if(d_osps == 2) {
+	if(telemetry) {
+	  d_kernels[0] = &my_pfb_clock_sync_impl::work_kernel<2, true, false>;
+	  d_kernels[1] = &my_pfb_clock_sync_impl::work_kernel<2, true, true>;
+	}
+	else {
+	  d_kernels[0] = &my_pfb_clock_sync_impl::work_kernel<2, false, false>;
+	  d_kernels[1] = &my_pfb_clock_sync_impl::work_kernel<2, false, true>;
+	}
+      }
+      else {
+	if(telemetry) {
+	  d_kernels[0] = &my_pfb_clock_sync_impl::work_kernel<0, true, false>;
+	  d_kernels[1] = &my_pfb_clock_sync_impl::work_kernel<0, true, true>;
+	}
+	else {
+	  d_kernels[0] = &my_pfb_clock_sync_impl::work_kernel<0, false, false>;
+	  d_kernels[1] = &my_pfb_clock_sync_impl::work_kernel<0, false, true>;
+	}
+      }
+    }
+
+    // The symbol loop, specialized on the output samples per symbol
+    // (OSPS == 0 uses d_osps), connected telemetry outputs and
+    // pending "time_est" tags. Returns the number of produced items,
+    // count is advanced by the consumed items and ntelem by the
+    // written telemetry items.
+    template<int OSPS, bool TELEMETRY, bool TAGS>
+    int
+    my_pfb_clock_sync_impl::work_kernel(int noutput_items,
+					 const gr_complex *in, gr_complex *out,
+					 float *err, float *outrate, float *outk,
+					 std::vector<tag_t> &tags, int ninput,
+					 int &count, int &ntelem)
+    {
+      const int osps = (OSPS > 0) ? OSPS : d_osps;
+
+      // Last symbol starts that neither read nor consume beyond the
+      // input. ninput includes the history, which can be read but not
+      // consumed.
+      const int read_limit = ninput - input_window() - osps - 1;
+      const int consume_limit = ninput - (int)history() + 1 - (int)d_sps - 2;
+
+      int i = 0;
+      float error_r, error_i;
+
+      // produce output as long as we can and there are enough input samples
+      while(i < noutput_items) {
+	// Parameter updates are taken over between symbols
+	if(d_out_idx == 0 && d_mailbox.load(boost::memory_order_relaxed)) {
+	  take_params();
+	}
+
+	int start = count + (int)floor(d_k / d_nfilters);
+	if(d_out_idx == 0 && (start > read_limit || start > consume_limit)) {
+	  break;
+	}
+
+        if(TAGS && tags.size() > 0) {
+          size_t offset = tags[0].offset-nitems_read(0);
+          if((offset >= (size_t)count) && (offset < (size_t)(count + d_sps))) {
+            float center = (float)pmt::to_double(tags[0].value);
+            d_k = (offset-count - d_sps/2.0) * d_nfilters + (M_PI*center*d_nfilters);
+            tags.erase(tags.begin());
+            reset_lock();
+          }
+        }
+
+	gr_complex diff;
+	bool have_diff = false;
+	float mu = 0;
+	float k_sym = 0;
+
+	while(d_out_idx < osps) {
+
+	  d_filtnum = (int)floor(d_k);
+
+	  // Keep the current filter number in [0, d_nfilters]
+	  // If we've run beyond the last filter, wrap around and go to next sample
+	  // If we've gone below 0, wrap around and go to previous sample
+	  if(d_filtnum >= d_nfilters || d_filtnum < 0) {
+	    int wrap = d_filtnum / d_nfilters;
+	    if(d_filtnum < 0 && wrap * d_nfilters != d_filtnum) {
+	      wrap -= 1;
+	    }
+	    d_k -= wrap * d_nfilters;
+	    d_filtnum -= wrap * d_nfilters;
+	    count += wrap;
+	  }
+
+	  if(d_out_idx == 0) {
+	    k_sym = d_k;
+	  }
+
+	  if(d_interp == INTERP_CUBIC) {
+	    mu = d_k / d_nfilters;
+	    d_bank->interpolate(&in[count+d_out_idx], mu, out[i+d_out_idx], diff);
+	    have_diff = (osps == 1);
+	  }
+	  // With one output per symbol the derivative uses the same
+	  // arm and input window, so compute both in one pass
+	  else if(osps == 1 && d_ted == TED_ML) {
+	    d_bank->filter_fused(d_filtnum, &in[count], out[i], diff);
+	    have_diff = true;
+	  }
+	  else {
+	    out[i+d_out_idx] = d_bank->filter(d_filtnum, &in[count+d_out_idx]);
+	  }
+	  d_k = d_k + d_rate_i + d_rate_f; // update phase
+	  d_out_idx++;
 
 	  // We've run out of output items we can create; return now.
 	  if(i+d_out_idx >= noutput_items) {
-	    consume_each(count);
 	    return i;
 	  }
 	}
@@ -499,30 +2008,97 @@ namespace gr {
 	d_out_idx = 0;
 
 	// Update the phase and rate estimates for this symbol
-	gr_complex diff = d_diff_filters[d_filtnum]->filter(&in[count]);
-	error_r = out[i].real() * diff.real();
-	error_i = out[i].imag() * diff.imag();
-	d_error = (error_i + error_r) / 2.0;       // average error from I&Q channel
+	if(d_ted == TED_ML) {
+	  if(!have_diff) {
+	    if(d_interp == INTERP_CUBIC) {
+	      gr_complex tmp;
+	      d_bank->interpolate(&in[count], mu, tmp, diff);
+	    }
+	    else {
+	      diff = d_bank->filter_diff(d_filtnum, &in[count]);
+	    }
+	  }
+	  error_r = out[i].real() * diff.real();
+	  error_i = out[i].imag() * diff.imag();
+	  d_error = (error_i + error_r) / 2.0;       // average error from I&Q channel
+	}
+	else {
+	  d_error = ted_error(out[i], in, count, k_sym);
+	}
 
         // Run the control loop to update the current phase (k) and
         // tracking rate estimates based on the error value
         // Interpolating here to update rates for ever sps.
         for(int s = 0; s < d_sps; s++) {
-          d_rate_f = d_rate_f + d_beta*d_error;
-          d_k = d_k + d_rate_f + d_alpha*d_error;
+          d_rate_f = d_rate_f + d_gain_beta*d_error;
+          d_k = d_k + d_rate_f + d_gain_alpha*d_error;
         }
 
 	// Keep our rate within a good range
 	d_rate_f = gr::branchless_clip(d_rate_f, d_max_dev);
 
-	i+=d_osps;
+	d_error_stats.add(d_error);
+	d_rate_stats.add(d_rate_f);
+	update_lock(i);
+
+	// One telemetry item per symbol, decimated by d_telem_decim
+	if(TELEMETRY && ++d_telem_count >= d_telem_decim) {
+	  d_telem_count = 0;
+	  err[ntelem] = d_error;
+	  outrate[ntelem] = d_rate_f;
+	  outk[ntelem] = d_k;
+	  ntelem++;
+	}
+
+	i+=osps;
 	count += (int)floor(d_sps);
       }
 
-      consume_each(count);
       return i;
     }
 
+    // Matched filter output at phase k relative to in[count], k may
+    // exceed the filter range and is wrapped into count
+    gr_complex
+    my_pfb_clock_sync_impl::matched_at(const gr_complex *in, int count, float k) const
+    {
+      int shift = (int)floor(k / d_nfilters);
+      count += shift;
+      k -= shift * d_nfilters;
+
+      gr_complex y, dy;
+      if(d_interp == INTERP_CUBIC) {
+	d_bank->interpolate(&in[count], k / d_nfilters, y, dy);
+      }
+      else {
+	y = d_bank->filter(std::min((int)k, d_nfilters-1), &in[count]);
+      }
+      return y;
+    }
+
+    // Error of the derivative free detectors for the symbol sym taken at
+    // phase k of in[count]
+    float
+    my_pfb_clock_sync_impl::ted_error(const gr_complex &sym, const gr_complex *in, int count, float k)
+    {
+      gr_complex e;
+      if(d_ted == TED_GARDNER) {
+	e = (d_prev_sym - sym) * std::conj(d_mid_sym);
+
+	// Midpoint to the next symbol, half a symbol ahead
+	d_mid_sym = matched_at(in, count, k + 0.5 * d_last_sps * d_nfilters);
+      }
+      else {
+	gr_complex dec((sym.real() > 0) ? 1 : -1, (sym.imag() > 0) ? 1 : -1);
+	e = sym * std::conj(d_prev_dec) - d_prev_sym * std::conj(dec);
+	d_prev_dec = dec;
+      }
+      d_prev_sym = sym;
+
+      // Real part averages the error of the I&Q channel like TED_ML
+      return e.real() / 2.0;
+    }
+
     void
     my_pfb_clock_sync_impl::setup_rpc()
     {
@@ -552,6 +2128,62 @@ namespace gr {
 	      "", "Current filter phase arm", RPC_PRIVLVL_MIN,
               DISPTIME | DISPOPTSTRIP)));
 
+      add_rpc_variable(
+          rpcbasic_sptr(new rpcbasic_register_get<my_pfb_clock_sync, float>(
+	      alias(), "error mean",
+	      &my_pfb_clock_sync::error_mean,
+	      pmt::mp(-2.0f), pmt::mp(2.0f), pmt::mp(0.0f),
+	      "", "Mean of the loop error", RPC_PRIVLVL_MIN,
+              DISPTIME | DISPOPTSTRIP)));
+
+      add_rpc_variable(
+          rpcbasic_sptr(new rpcbasic_register_get<my_pfb_clock_sync, float>(
+	      alias(), "error variance",
+	      &my_pfb_clock_sync::error_variance,
+	      pmt::mp(0.0f), pmt::mp(4.0f), pmt::mp(0.0f),
+	      "", "Variance of the loop error", RPC_PRIVLVL_MIN,
+              DISPTIME | DISPOPTSTRIP)));
+
+      add_rpc_variable(
+          rpcbasic_sptr(new rpcbasic_register_get<my_pfb_clock_sync, float>(
+	      alias(), "rate mean",
+	      &my_pfb_clock_sync::rate_mean,
+	      pmt::mp(-2.0f), pmt::mp(2.0f), pmt::mp(0.0f),
+	      "", "Mean of the rate", RPC_PRIVLVL_MIN,
+              DISPTIME | DISPOPTSTRIP)));
+
+      add_rpc_variable(
+          rpcbasic_sptr(new rpcbasic_register_get<my_pfb_clock_sync, float>(
+	      alias(), "rate variance",
+	      &my_pfb_clock_sync::rate_variance,
+	      pmt::mp(0.0f), pmt::mp(4.0f), pmt::mp(0.0f),
+	      "", "Variance of the rate", RPC_PRIVLVL_MIN,
+              DISPTIME | DISPOPTSTRIP)));
+
+      add_rpc_variable(
+          rpcbasic_sptr(new rpcbasic_register_get<my_pfb_clock_sync, std::vector<float> >(
+	      alias(), "error histogram",
+	      &my_pfb_clock_sync::error_histogram,
+	      pmt::make_f32vector(1,0), pmt::make_f32vector(1,1e9), pmt::make_f32vector(1,0),
+	      "", "Histogram of the loop error over [-2, 2]", RPC_PRIVLVL_MIN,
+              DISPXY | DISPOPTSCATTER)));
+
+      add_rpc_variable(
+          rpcbasic_sptr(new rpcbasic_register_get<my_pfb_clock_sync, std::vector<float> >(
+	      alias(), "rate histogram",
+	      &my_pfb_clock_sync::rate_histogram,
+	      pmt::make_f32vector(1,0), pmt::make_f32vector(1,1e9), pmt::make_f32vector(1,0),
+	      "", "Histogram of the rate over the max deviation", RPC_PRIVLVL_MIN,
+              DISPXY | DISPOPTSCATTER)));
+
+      add_rpc_variable(
+          rpcbasic_sptr(new rpcbasic_register_get<my_pfb_clock_sync, int>(
+	      alias(), "telemetry decimation",
+	      &my_pfb_clock_sync::telemetry_decimation,
+	      pmt::mp(1), pmt::mp(100000), pmt::mp(1),
+	      "symbols", "Decimation of the telemetry outputs",
+	      RPC_PRIVLVL_MIN, DISPNULL)));
+
       add_rpc_variable(
           rpcbasic_sptr(new rpcbasic_register_get<my_pfb_clock_sync, float>(
 	      alias(), "loop bw",
@@ -560,6 +2192,63 @@ namespace gr {
 	      "", "Loop bandwidth",
 	      RPC_PRIVLVL_MIN, DISPNULL)));
 
+      // Performance counters
+      add_rpc_variable(
+          rpcbasic_sptr(new rpcbasic_register_get<my_pfb_clock_sync, uint64_t>(
+	      alias(), "symbols produced",
+	      &my_pfb_clock_sync::symbols_produced,
+	      pmt::from_uint64(0), pmt::from_uint64(~0ULL), pmt::from_uint64(0),
+	      "symbols", "Symbols produced", RPC_PRIVLVL_MIN,
+              DISPTIME | DISPOPTSTRIP)));
+
+      add_rpc_variable(
+          rpcbasic_sptr(new rpcbasic_register_get<my_pfb_clock_sync, double>(
+	      alias(), "work time",
+	      &my_pfb_clock_sync::work_time,
+	      pmt::mp(0.0), pmt::mp(1e9), pmt::mp(0.0),
+	      "s", "Time spent in the loop", RPC_PRIVLVL_MIN,
+              DISPTIME | DISPOPTSTRIP)));
+
+      add_rpc_variable(
+          rpcbasic_sptr(new rpcbasic_register_get<my_pfb_clock_sync, uint64_t>(
+	      alias(), "zero output calls",
+	      &my_pfb_clock_sync::zero_output_calls,
+	      pmt::from_uint64(0), pmt::from_uint64(~0ULL), pmt::from_uint64(0),
+	      "calls", "Calls that produced no symbol", RPC_PRIVLVL_MIN,
+              DISPTIME | DISPOPTSTRIP)));
+
+      add_rpc_variable(
+          rpcbasic_sptr(new rpcbasic_register_get<my_pfb_clock_sync, uint64_t>(
+	      alias(), "retunes",
+	      &my_pfb_clock_sync::retunes,
+	      pmt::from_uint64(0), pmt::from_uint64(~0ULL), pmt::from_uint64(0),
+	      "", "sps changes applied", RPC_PRIVLVL_MIN,
+              DISPTIME | DISPOPTSTRIP)));
+
+      add_rpc_variable(
+          rpcbasic_sptr(new rpcbasic_register_get<my_pfb_clock_sync, uint64_t>(
+	      alias(), "banks designed",
+	      &my_pfb_clock_sync::banks_designed,
+	      pmt::from_uint64(0), pmt::from_uint64(~0ULL), pmt::from_uint64(0),
+	      "", "Filterbanks designed", RPC_PRIVLVL_MIN,
+              DISPTIME | DISPOPTSTRIP)));
+
+      add_rpc_variable(
+          rpcbasic_sptr(new rpcbasic_register_get<my_pfb_clock_sync, double>(
+	      alias(), "design time",
+	      &my_pfb_clock_sync::design_time,
+	      pmt::mp(0.0), pmt::mp(1e9), pmt::mp(0.0),
+	      "s", "Time spent designing filterbanks", RPC_PRIVLVL_MIN,
+              DISPTIME | DISPOPTSTRIP)));
+
+      add_rpc_variable(
+          rpcbasic_sptr(new rpcbasic_register_get<my_pfb_clock_sync, uint64_t>(
+	      alias(), "tags emitted",
+	      &my_pfb_clock_sync::tags_emitted,
+	      pmt::from_uint64(0), pmt::from_uint64(~0ULL), pmt::from_uint64(0),
+	      "tags", "clock_lock tags added", RPC_PRIVLVL_MIN,
+              DISPTIME | DISPOPTSTRIP)));
+
       // Setters
       add_rpc_variable(
           rpcbasic_sptr(new rpcbasic_register_set<my_pfb_clock_sync, float>(
@@ -568,6 +2257,14 @@ namespace gr {
 	      pmt::mp(0.0f), pmt::mp(1.0f), pmt::mp(0.0f),
 	      "", "Loop bandwidth",
 	      RPC_PRIVLVL_MIN, DISPNULL)));
+
+      add_rpc_variable(
+          rpcbasic_sptr(new rpcbasic_register_set<my_pfb_clock_sync, int>(
+	      alias(), "telemetry decimation",
+	      &my_pfb_clock_sync::set_telemetry_decimation,
+	      pmt::mp(1), pmt::mp(100000), pmt::mp(1),
+	      "symbols", "Decimation of the telemetry outputs",
+	      RPC_PRIVLVL_MIN, DISPNULL)));
 #endif /* GR_CTRLPORT */
     }
 
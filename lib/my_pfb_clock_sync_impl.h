@@ -23,33 +23,235 @@
 #define INCLUDED_CBMC_MY_PFB_CLOCK_SYNC_IMPL_H
 
 #include <cbmc/my_pfb_clock_sync.h>
+#include <gnuradio/thread/thread.h>
+#include <boost/noncopyable.hpp>
+#include <boost/atomic.hpp>
+#include <list>
+#include "perf_counters.h"
 
 using namespace gr::filter;
 
 namespace gr {
   namespace cbmc {
 
-    class my_pfb_clock_sync_impl : public my_pfb_clock_sync
+    /*!
+     * Matched and derivative polyphase filterbanks designed for one
+     * sps. Banks are shared between the active set and the cache, so
+     * switching to a cached bank is a pointer swap.
+     *
+     * All arms live in one aligned tap matrix. Arm i holds the time
+     * reversed matched taps followed by the reversed derivative taps,
+     * each tap duplicated for the real and imaginary part, so both
+     * outputs are computed from a single pass over the input.
+     *
+     * quantize() adds a Q15 copy of the taps for sc16 input, see
+     * filter_fused_q15().
+     */
+    struct CBMC_API filter_bank : boost::noncopyable
+    {
+      filter_bank(int nfilters, int taps_per_filter);
+      ~filter_bank();
+
+      // Polyphase matched and derivative bank of a prototype filter
+      static boost::shared_ptr<filter_bank> make_pfb(int nfilters,
+						      const std::vector<float> &taps);
+      static int partition(int nfilters, const std::vector<float> &taps,
+			   std::vector< std::vector<float> > &ourtaps);
+      static void diff_taps(int nfilters, const std::vector<float> &taps,
+			    std::vector<float> &difftaps);
+
+      void set_arm(int arm, const std::vector<float> &taps,
+		   const std::vector<float> &dtaps);
+      std::vector<float> arm_taps(int arm) const;
+      std::vector<float> arm_diff_taps(int arm) const;
+      std::vector<float> prototype() const;
+      void copy_taps(float *out, bool derivative) const;
+
+      const float *matched(int arm) const { return coeffs + arm*stride; }
+      const float *diff(int arm) const { return coeffs + arm*stride + stride/2; }
+
+      gr_complex filter(int arm, const gr_complex *in) const;
+      gr_complex filter_diff(int arm, const gr_complex *in) const;
+      void filter_fused(int arm, const gr_complex *in,
+			gr_complex &out, gr_complex &dout) const;
+      void interpolate(const gr_complex *in, float mu,
+		       gr_complex &out, gr_complex &dout) const;
+
+      void quantize();
+      const short *qmatched(int arm) const { return qcoeffs + arm*qstride; }
+      const short *qdiff(int arm) const { return qcoeffs + arm*qstride + qstride/2; }
+      void filter_fused_q15(int arm, const short *in,
+			    gr_complex &out, gr_complex &dout) const;
+
+      int    nfilters;
+      int    taps_per_filter;
+      int    stride;          // floats per arm, both filters
+      float *coeffs;
+      float  dgain;           // derivative normalization of INTERP_CUBIC
+
+      // Q15 taps, NULL until quantize(). Taps come in pairs for
+      // _mm_madd_epi16: r0 r1 r0 r1 r2 r3 r2 r3 for 4 input samples
+      int    qstride;         // shorts per arm, both filters
+      short *qcoeffs;
+      float  qgain;           // output scale of the matched filter
+      float  qdgain;          // output scale of the derivative filter
+    };
+
+    typedef boost::shared_ptr<filter_bank> filter_bank_sptr;
+
+    /*!
+     * Root raised cosine designed for each sps. Copied into design
+     * jobs, so the design thread never reads the live settings.
+     */
+    struct CBMC_API rrc_params
+    {
+      // Taps per arm if no span is given
+      static const int legacy_taps = 45;
+
+      int taps_per_filter(double sps) const;
+      std::vector<float> prototype(int nfilters, double sps) const;
+
+      float rolloff;
+      float span;       // symbols per arm, 0 for legacy_taps taps
+      int   window;     // filter::firdes::win_type, -1 for none
+    };
+
+    /*!
+     * Loop parameters as set by the user. Setters change a copy and
+     * publish it to the streaming thread, which takes it over at the
+     * next symbol boundary.
+     */
+    struct loop_params
+    {
+      void update_gains();
+      void update_acq_gains();
+
+      float loop_bw;
+      float damping;
+      float alpha;
+      float beta;
+      float acq_bw;
+      float acq_alpha;
+      float acq_beta;
+      float lock_th;
+      float max_dev;
+      int   telem_decim;
+      int   max_latency;    // symbols per call, 0 if unbounded
+    };
+
+    /*!
+     * A loop state checked by parse_state(). It is restored right away
+     * when the bank of its sps is cached, else it goes with a design
+     * job and general_work restores it with the designed bank.
+     */
+    struct saved_state
+    {
+      double             sps;
+      bool               has_phase;
+      float              phase;
+      bool               has_rate;
+      float              rate;
+      bool               locked;
+      std::vector<float> taps;      // empty for the bank of the sps
+    };
+
+    typedef boost::shared_ptr<saved_state> saved_state_sptr;
+
+    /*!
+     * Mean, variance and histogram of a loop variable. Values outside
+     * [-range, range] are counted in the outer bins.
+     */
+    struct running_stats
+    {
+      running_stats(int nbins, float range);
+
+      void add(float x)
+      {
+	n += 1;
+	sum += x;
+	sumsq += x*x;
+	int bin = (int)floor((x + range) * scale);
+	bin = std::max(0, std::min(bin, (int)hist.size()-1));
+	hist[bin] += 1;
+      }
+
+      void reset();
+      void set_range(float r);
+      float mean() const;
+      float variance() const;
+
+      double             n;
+      double             sum;
+      double             sumsq;
+      float              range;
+      float              scale;     // bins per unit
+      std::vector<float> hist;
+    };
+
+    class CBMC_API my_pfb_clock_sync_impl : public my_pfb_clock_sync
     {
     private:
+      // Number of designed banks kept for reuse, least recently used are dropped
+      static const unsigned int d_bank_cache_size = 8;
+      // sps is quantized to 1/d_sps_quant before designing and cache lookup
+      static const int          d_sps_quant = 1000;
+      // Largest sps accepted from "det_sps" tags, bounds the history
+      static const int          d_max_sps = 50;
+
       unsigned int d_det_block_size;
-      bool   d_updated;
+      interp_type  d_interp;
+      ted_type     d_ted;
       double d_sps;
-      double d_last_sps;
+      double d_last_sps;        // sps of the bank in use
+      double d_requested_sps;   // latest requested, may still be designed
       double d_sample_num;
       float  d_loop_bw;
       float  d_damping;
       float  d_alpha;
       float  d_beta;
 
+      // Gear shift between acquisition and tracking gains
+      float  d_acq_bw;
+      float  d_acq_alpha;
+      float  d_acq_beta;
+      float  d_gain_alpha;      // gains used by the loop
+      float  d_gain_beta;
+      bool   d_locked;
+      float  d_lock_th;
+      float  d_lock_avg;        // smoothed squared error
+      int    d_lock_count;      // symbols since the last reset
+
+      // Parameter updates: d_req is the latest request, guarded by
+      // d_req_mutex among callers; published copies are exchanged
+      // through d_mailbox so general_work never waits on a caller
+      loop_params                  d_req;
+      mutable gr::thread::mutex    d_req_mutex;
+      boost::atomic<loop_params *> d_mailbox;
+
       int                                  d_nfilters;
       int                                  d_taps_per_filter;
-      std::vector<kernel::fir_filter_ccf*> d_filters;
-      std::vector<kernel::fir_filter_ccf*> d_diff_filters;
+      filter_bank_sptr                     d_bank;
+      std::list< std::pair<long, filter_bank_sptr> > d_bank_cache;
       std::vector<float>                   d_init_taps;
-      std::vector< std::vector<float> >    d_taps;
-      std::vector< std::vector<float> >    d_dtaps;
-      std::vector<float>                   d_updated_taps;
+      rrc_params                           d_rrc;
+      double                               d_rejected_sps;  // warned about once
+
+      // Filter design thread, new banks are handed over in d_pending_bank
+      // and swapped in by general_work at the next symbol boundary
+      gr::thread::thread                   d_design_thread;
+      mutable gr::thread::mutex            d_design_mutex;
+      gr::thread::condition_variable       d_design_cond;
+      bool                                 d_design_stop;
+      bool                                 d_job_pending;
+      unsigned long                        d_design_gen;  // outdates older jobs
+      double                               d_job_sps;   // <= 0 for user taps
+      std::vector<float>                   d_job_taps;
+      rrc_params                           d_job_rrc;
+      saved_state_sptr                     d_job_state;
+      filter_bank_sptr                     d_pending_bank;
+      double                               d_pending_sps;
+      saved_state_sptr                     d_pending_state;
+      unsigned long                        d_pending_gen;
 
       float d_init_phase;
       float d_k;
@@ -62,8 +264,86 @@ namespace gr {
       float d_error;
       int   d_out_idx;
 
+      int           d_max_latency;  // symbols per call, 0 if unbounded
+      int           d_telem_decim;
+      int           d_telem_count;  // symbols since the last telemetry item
+      running_stats d_error_stats;
+      running_stats d_rate_stats;
+
+      // Performance counters, designs also count from the design thread
+      perf_counter          d_pc_symbols;
+      perf_counter          d_pc_work_ns;
+      perf_counter          d_pc_idle;
+      perf_counter          d_pc_tags;
+      perf_counter          d_pc_retunes;
+      mutable perf_counter  d_pc_designs;
+      mutable perf_counter  d_pc_design_ns;
+
+      // Gardner and Mueller and Mueller state of the last symbol
+      gr_complex d_prev_sym;
+      gr_complex d_prev_dec;
+      gr_complex d_mid_sym;
+
       void create_diff_taps(const std::vector<float> &newtaps,
-			    std::vector<float> &difftaps);
+			    std::vector<float> &difftaps) const;
+
+      int partition_taps(const std::vector<float> &newtaps,
+			 std::vector< std::vector<float> > &ourtaps) const;
+      filter_bank_sptr design_bank(const std::vector<float> &newtaps) const;
+      filter_bank_sptr design_cubic_bank(const std::vector<float> &newtaps) const;
+      unsigned int required_history(int taps_per_filter, double sps) const;
+      bool fits(int taps_per_filter, double sps) const;
+      rrc_params current_rrc() const;
+      filter_bank_sptr design_rrc_bank(long key, const rrc_params &p) const;
+      filter_bank_sptr find_cached_bank(long key);
+      void cache_bank(long key, filter_bank_sptr bank);
+      void insert_cached_bank(long key, filter_bank_sptr bank);
+      void set_bank(filter_bank_sptr bank);
+      void apply_sps(double sps, filter_bank_sptr bank);
+      void request_sps(double sps);
+      void post_design_job(double sps, const std::vector<float> &taps,
+			   saved_state_sptr state = saved_state_sptr());
+      void swap_pending_bank();
+      void cancel_design_jobs();
+      std::string parse_state(pmt::pmt_t state, saved_state &st);
+      void restore_state(saved_state_sptr st);
+      void apply_state(const saved_state &st, filter_bank_sptr bank);
+      void handle_state(pmt::pmt_t msg);
+
+      // gr::block::d_setlock for the const getters
+      gr::thread::mutex &setlock() const
+      {
+	return const_cast<my_pfb_clock_sync_impl *>(this)->d_setlock;
+      }
+      void design_thread();
+
+      // Specialized symbol loops, indexed by pending "time_est" tags
+      typedef int (my_pfb_clock_sync_impl::*work_kernel_t)(int noutput_items,
+							    const gr_complex *in, gr_complex *out,
+							    float *err, float *outrate, float *outk,
+							    std::vector<tag_t> &tags, int ninput,
+							    int &count, int &ntelem);
+      work_kernel_t d_kernels[2];
+
+      void select_kernels(bool telemetry);
+      template<int OSPS, bool TELEMETRY, bool TAGS>
+      int work_kernel(int noutput_items,
+		      const gr_complex *in, gr_complex *out,
+		      float *err, float *outrate, float *outk,
+		      std::vector<tag_t> &tags, int ninput,
+		      int &count, int &ntelem);
+
+      int input_window() const;
+      int required_input(int nsymbols) const;
+
+      gr_complex matched_at(const gr_complex *in, int count, float k) const;
+      float ted_error(const gr_complex &sym, const gr_complex *in, int count, float k);
+
+      void publish_params();
+      void take_params();
+      void apply_gains();
+      void reset_lock();
+      void update_lock(int out_idx);
 
     public:
       my_pfb_clock_sync_impl(double sps, float loop_bw,
@@ -71,9 +351,17 @@ namespace gr {
 			      float init_phase=0,
 			      float max_rate_deviation=1.5,
 			      int osps=1,
-			      unsigned int det_block_size=10000);
+			      unsigned int det_block_size=10000,
+			      interp_type interp=INTERP_PFB,
+			      ted_type ted=TED_ML,
+			      float rolloff=0.35,
+			      float span=0,
+			      int window=-1);
       ~my_pfb_clock_sync_impl();
 
+      bool start();
+      bool stop();
+
       void setup_rpc();
 
       void update_gains();
@@ -92,6 +380,9 @@ namespace gr {
       std::vector< std::vector<float> > diff_taps() const;
       std::vector<float> channel_taps(int channel) const;
       std::vector<float> diff_channel_taps(int channel) const;
+      std::vector<int> taps_shape() const;
+      size_t taps_into(float *out, size_t max);
+      size_t diff_taps_into(float *out, size_t max);
       std::string taps_as_string() const;
       std::string diff_taps_as_string() const;
 
@@ -99,10 +390,17 @@ namespace gr {
       void set_damping_factor(float df);
       void set_alpha(float alpha);
       void set_beta(float beta);
-      void set_max_rate_deviation(float m)
-      {
-	d_max_dev = m;
-      }
+      void set_max_rate_deviation(float m);
+      void set_telemetry_decimation(int decim);
+      void set_max_latency(int nsymbols);
+      void set_matched_filter(float rolloff, float span, int window);
+      void set_matched_filter_preset(mf_preset preset);
+      void set_acquisition_bandwidth(float bw);
+      void set_lock_threshold(float th);
+      void reset_statistics();
+      void reset_counters();
+      void set_loop_state(pmt::pmt_t state);
+      pmt::pmt_t loop_state() const;
 
       float loop_bandwidth() const;
       float damping_factor() const;
@@ -114,6 +412,28 @@ namespace gr {
       float rate() const;
       float phase() const;
 
+      int telemetry_decimation() const;
+      int max_latency() const;
+      float rolloff() const;
+      float span() const;
+      int window() const;
+      float acquisition_bandwidth() const;
+      float lock_threshold() const;
+      bool locked() const;
+      float error_mean() const;
+      float error_variance() const;
+      float rate_mean() const;
+      float rate_variance() const;
+      std::vector<float> error_histogram() const;
+      std::vector<float> rate_histogram() const;
+      uint64_t symbols_produced() const;
+      double work_time() const;
+      uint64_t zero_output_calls() const;
+      uint64_t retunes() const;
+      uint64_t banks_designed() const;
+      double design_time() const;
+      uint64_t tags_emitted() const;
+
 
       /*******************************************************************
        *******************************************************************/
@@ -0,0 +1,481 @@
+/* -*- c++ -*- */
+/* 
+ * Copyright 2016 <+YOU OR YOUR COMPANY+>.
+ * 
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ * 
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <cmath>
+#include <algorithm>
+#include <stdexcept>
+
+#include <gnuradio/io_signature.h>
+#include "my_pfb_clock_sync_mc_impl.h"
+#include <gnuradio/math.h>
+#include <boost/math/special_functions/round.hpp>
+
+namespace gr {
+  namespace cbmc {
+
+    my_pfb_clock_sync_mc::sptr
+    my_pfb_clock_sync_mc::make(int nchannels, double sps, float loop_bw,
+				unsigned int filter_size,
+				float init_phase,
+				float max_rate_deviation,
+				float rolloff,
+				float span,
+				int window,
+				sample_format format)
+    {
+      return gnuradio::get_initial_sptr
+	(new my_pfb_clock_sync_mc_impl(nchannels, sps, loop_bw,
+					filter_size, init_phase,
+					max_rate_deviation,
+					rolloff, span, window, format));
+    }
+
+    my_pfb_clock_sync_mc_impl::my_pfb_clock_sync_mc_impl(int nchannels, double sps,
+							   float loop_bw,
+							   unsigned int filter_size,
+							   float init_phase,
+							   float max_rate_deviation,
+							   float rolloff,
+							   float span,
+							   int window,
+							   sample_format format)
+      : block("my_pfb_clock_sync_mc",
+	      io_signature::make(checked_nchannels(nchannels), nchannels,
+				 (format == SAMPLES_SC16) ? 2*sizeof(short) : sizeof(gr_complex)),
+	      io_signature::make(nchannels, nchannels, sizeof(gr_complex))),
+	d_nchans(nchannels), d_format(format), d_nfilters(filter_size),
+	d_rate(0), d_rate_i(0), d_max_dev(max_rate_deviation), d_chans(nchannels)
+    {
+      if(rolloff <= 0 || rolloff > 1) {
+	throw std::out_of_range("my_pfb_clock_sync_mc: invalid roll-off. Must be in (0, 1].");
+      }
+      if(span < 0) {
+	throw std::out_of_range("my_pfb_clock_sync_mc: invalid span. Must be >= 0.");
+      }
+
+      // Let scheduler adjust our relative_rate.
+      enable_update_rate(true);
+
+      // Set the damping factor for a critically damped system
+      d_damping = 2*d_nfilters;
+      set_loop_bandwidth(loop_bw);
+
+      d_rrc.rolloff = rolloff;
+      d_rrc.span = span;
+      d_rrc.window = window;
+
+      for(int c = 0; c < d_nchans; c++) {
+	d_chans[c].k = init_phase;
+	d_chans[c].error = 0;
+      }
+
+      // History for the largest sps, so set_sps never has to grow it
+      set_history(d_rrc.taps_per_filter(d_max_sps) + 2*d_max_sps);
+
+      set_sps(sps);
+    }
+
+    my_pfb_clock_sync_mc_impl::~my_pfb_clock_sync_mc_impl()
+    {
+    }
+
+    // Checked before the io signatures and d_chans are sized by it
+    int
+    my_pfb_clock_sync_mc_impl::checked_nchannels(int nchannels)
+    {
+      if(nchannels < 1) {
+	throw std::out_of_range("my_pfb_clock_sync_mc: invalid number of channels. Must be >= 1.");
+      }
+      return nchannels;
+    }
+
+    void
+    my_pfb_clock_sync_mc_impl::update_gains()
+    {
+      float denom = (1.0 + 2.0*d_damping*d_loop_bw + d_loop_bw*d_loop_bw);
+      d_alpha = (4*d_damping*d_loop_bw) / denom;
+      d_beta = (4*d_loop_bw*d_loop_bw) / denom;
+    }
+
+    void
+    my_pfb_clock_sync_mc_impl::set_sps(double sps)
+    {
+      retune(sps, false);
+    }
+
+    void
+    my_pfb_clock_sync_mc_impl::follow_sps(double sps)
+    {
+      retune(sps, true);
+    }
+
+    // With keep_rate, a cached bank keeps the deviation of every
+    // channel from the nominal rate; a new design resets it as set_sps
+    void
+    my_pfb_clock_sync_mc_impl::retune(double sps, bool keep_rate)
+    {
+      if(sps <= 0 || sps >= d_max_sps) {
+	throw std::out_of_range("my_pfb_clock_sync_mc: invalid sps.");
+      }
+
+      // Designed outside of the lock, work keeps running meanwhile.
+      // Like my_pfb_clock_sync, the bank is designed for the sps
+      // quantized to the cache key and reused while it is cached.
+      long key = boost::math::lround(sps * d_sps_quant);
+      filter_bank_sptr bank = find_cached_bank(key);
+      bool cached = (bank.get() != NULL);
+      if(!bank) {
+	{
+	  perf_timer timer(d_pc_design_ns);
+	  double qsps = (double)key / (double)d_sps_quant;
+	  bank = filter_bank::make_pfb(d_nfilters, d_rrc.prototype(d_nfilters, qsps));
+	  if(d_format == SAMPLES_SC16) {
+	    bank->quantize();
+	  }
+	}
+	d_pc_designs.add();
+	cache_bank(key, bank);
+      }
+
+      gr::thread::scoped_lock guard(d_setlock);
+      float old_rate_f = d_rate - (float)d_rate_i;
+      d_bank = bank;
+      d_taps_per_filter = bank->taps_per_filter;
+      d_sps = floor(sps);
+      d_rate = (sps-floor(sps))*(double)d_nfilters;
+      d_rate_i = (int)floor(d_rate);
+      float rate_f = d_rate - (float)d_rate_i;
+      for(int c = 0; c < d_nchans; c++) {
+	if(keep_rate && cached) {
+	  d_chans[c].rate_f += rate_f - old_rate_f;
+	}
+	else {
+	  d_chans[c].rate_f = rate_f;
+	}
+      }
+
+      set_relative_rate(1.0/d_sps);
+      d_pc_retunes.add();
+    }
+
+    void
+    my_pfb_clock_sync_mc_impl::set_loop_bandwidth(float bw)
+    {
+      if(bw < 0) {
+	throw std::out_of_range("my_pfb_clock_sync_mc: invalid bandwidth. Must be >= 0.");
+      }
+
+      // work_channel reads the gains under d_setlock
+      gr::thread::scoped_lock guard(d_setlock);
+      d_loop_bw = bw;
+      update_gains();
+    }
+
+    void
+    my_pfb_clock_sync_mc_impl::set_max_rate_deviation(float m)
+    {
+      gr::thread::scoped_lock guard(d_setlock);
+      d_max_dev = m;
+    }
+
+    filter_bank_sptr
+    my_pfb_clock_sync_mc_impl::find_cached_bank(long key)
+    {
+      gr::thread::scoped_lock lock(d_cache_mutex);
+
+      std::list< std::pair<long, filter_bank_sptr> >::iterator it;
+      for(it = d_bank_cache.begin(); it != d_bank_cache.end(); it++) {
+	if(it->first == key) {
+	  // Move to the front, it is now the most recently used
+	  d_bank_cache.splice(d_bank_cache.begin(), d_bank_cache, it);
+	  return d_bank_cache.front().second;
+	}
+      }
+      return filter_bank_sptr();
+    }
+
+    void
+    my_pfb_clock_sync_mc_impl::cache_bank(long key, filter_bank_sptr bank)
+    {
+      gr::thread::scoped_lock lock(d_cache_mutex);
+      d_bank_cache.push_front(std::make_pair(key, bank));
+      if(d_bank_cache.size() > d_bank_cache_size) {
+	d_bank_cache.pop_back();
+      }
+    }
+
+    void
+    my_pfb_clock_sync_mc_impl::reset_counters()
+    {
+      d_pc_symbols.reset();
+      d_pc_work_ns.reset();
+      d_pc_idle.reset();
+      d_pc_retunes.reset();
+      d_pc_designs.reset();
+      d_pc_design_ns.reset();
+    }
+
+    int
+    my_pfb_clock_sync_mc_impl::nchannels() const
+    {
+      return d_nchans;
+    }
+
+    float
+    my_pfb_clock_sync_mc_impl::loop_bandwidth() const
+    {
+      return d_loop_bw;
+    }
+
+    float
+    my_pfb_clock_sync_mc_impl::error(int channel) const
+    {
+      return d_chans.at(channel).error;
+    }
+
+    float
+    my_pfb_clock_sync_mc_impl::rate(int channel) const
+    {
+      return d_chans.at(channel).rate_f;
+    }
+
+    float
+    my_pfb_clock_sync_mc_impl::phase(int channel) const
+    {
+      return d_chans.at(channel).k;
+    }
+
+    uint64_t
+    my_pfb_clock_sync_mc_impl::symbols_produced() const
+    {
+      return d_pc_symbols.value();
+    }
+
+    double
+    my_pfb_clock_sync_mc_impl::work_time() const
+    {
+      return d_pc_work_ns.seconds();
+    }
+
+    uint64_t
+    my_pfb_clock_sync_mc_impl::zero_output_calls() const
+    {
+      return d_pc_idle.value();
+    }
+
+    uint64_t
+    my_pfb_clock_sync_mc_impl::retunes() const
+    {
+      return d_pc_retunes.value();
+    }
+
+    uint64_t
+    my_pfb_clock_sync_mc_impl::banks_designed() const
+    {
+      return d_pc_designs.value();
+    }
+
+    double
+    my_pfb_clock_sync_mc_impl::design_time() const
+    {
+      return d_pc_design_ns.seconds();
+    }
+
+    int
+    my_pfb_clock_sync_mc_impl::required_input(int nsymbols) const
+    {
+      // The channel furthest ahead in its input decides, see
+      // my_pfb_clock_sync_impl::required_input
+      float k = d_chans[0].k;
+      for(int c = 1; c < d_nchans; c++) {
+	k = std::max(k, d_chans[c].k);
+      }
+
+      double step = d_sps + ((d_rate_i + d_max_dev) + d_sps * d_max_dev) / d_nfilters;
+      double last = floor(k / d_nfilters) + (nsymbols - 1) * step;
+
+      int nread = (int)ceil(last) + 1 + d_taps_per_filter + 2;
+      int nconsume = (int)ceil(last) + (int)d_sps + 2 + (int)history() - 1;
+      return std::max(nread, nconsume);
+    }
+
+    void
+    my_pfb_clock_sync_mc_impl::forecast(int noutput_items,
+					 gr_vector_int &ninput_items_required)
+    {
+      int nreq = required_input(noutput_items);
+      for(unsigned i = 0; i < ninput_items_required.size(); i++) {
+	ninput_items_required[i] = nreq;
+      }
+    }
+
+    // The maximum likelihood loop of my_pfb_clock_sync with one output
+    // per symbol, on the loop state of one channel
+    int
+    my_pfb_clock_sync_mc_impl::work_channel(channel_state &st, int noutput_items,
+					    const void *in, gr_complex *out,
+					    int ninput, int &count)
+    {
+      const filter_bank &bank = *d_bank;
+      const gr_complex *fin = (const gr_complex *) in;
+      const short *qin = (const short *) in;
+
+      // Last symbol starts that neither read nor consume beyond the
+      // input. ninput includes the history, which can be read but not
+      // consumed.
+      const int read_limit = ninput - d_taps_per_filter - 2;
+      const int consume_limit = ninput - (int)history() + 1 - (int)d_sps - 2;
+
+      int i = 0;
+      while(i < noutput_items) {
+	int start = count + (int)floor(st.k / d_nfilters);
+	if(start > read_limit || start > consume_limit) {
+	  break;
+	}
+
+	int filtnum = (int)floor(st.k);
+	if(filtnum >= d_nfilters || filtnum < 0) {
+	  int wrap = filtnum / d_nfilters;
+	  if(filtnum < 0 && wrap * d_nfilters != filtnum) {
+	    wrap -= 1;
+	  }
+	  st.k -= wrap * d_nfilters;
+	  filtnum -= wrap * d_nfilters;
+	  count += wrap;
+	}
+
+	gr_complex diff;
+	if(d_format == SAMPLES_SC16) {
+	  bank.filter_fused_q15(filtnum, &qin[2*count], out[i], diff);
+	}
+	else {
+	  bank.filter_fused(filtnum, &fin[count], out[i], diff);
+	}
+	st.k = st.k + d_rate_i + st.rate_f;
+
+	float error_r = out[i].real() * diff.real();
+	float error_i = out[i].imag() * diff.imag();
+	st.error = (error_i + error_r) / 2.0;
+
+	for(int s = 0; s < d_sps; s++) {
+	  st.rate_f = st.rate_f + d_beta*st.error;
+	  st.k = st.k + st.rate_f + d_alpha*st.error;
+	}
+	st.rate_f = gr::branchless_clip(st.rate_f, d_max_dev);
+
+	i++;
+	count += (int)floor(d_sps);
+      }
+
+      return i;
+    }
+
+    int
+    my_pfb_clock_sync_mc_impl::general_work(int noutput_items,
+					     gr_vector_int &ninput_items,
+					     gr_vector_const_void_star &input_items,
+					     gr_vector_void_star &output_items)
+    {
+      perf_timer timer(d_pc_work_ns);
+
+      // All channels run back to back on the same taps, which stay
+      // in cache from one channel to the next
+      int total = 0;
+      for(int c = 0; c < d_nchans; c++) {
+	const void *in = input_items[c];
+	gr_complex *out = (gr_complex *) output_items[c];
+
+	int count = 0;
+	int nout = work_channel(d_chans[c], noutput_items, in, out,
+				ninput_items[c], count);
+	consume(c, count);
+	produce(c, nout);
+	total += nout;
+      }
+
+      d_pc_symbols.add(total);
+      if(total == 0) {
+	d_pc_idle.add();
+      }
+
+      return WORK_CALLED_PRODUCE;
+    }
+
+    void
+    my_pfb_clock_sync_mc_impl::setup_rpc()
+    {
+#ifdef GR_CTRLPORT
+      add_rpc_variable(
+          rpcbasic_sptr(new rpcbasic_register_get<my_pfb_clock_sync_mc, uint64_t>(
+	      alias(), "symbols produced",
+	      &my_pfb_clock_sync_mc::symbols_produced,
+	      pmt::from_uint64(0), pmt::from_uint64(~0ULL), pmt::from_uint64(0),
+	      "symbols", "Symbols produced", RPC_PRIVLVL_MIN,
+              DISPTIME | DISPOPTSTRIP)));
+
+      add_rpc_variable(
+          rpcbasic_sptr(new rpcbasic_register_get<my_pfb_clock_sync_mc, double>(
+	      alias(), "work time",
+	      &my_pfb_clock_sync_mc::work_time,
+	      pmt::mp(0.0), pmt::mp(1e9), pmt::mp(0.0),
+	      "s", "Time spent in the loop", RPC_PRIVLVL_MIN,
+              DISPTIME | DISPOPTSTRIP)));
+
+      add_rpc_variable(
+          rpcbasic_sptr(new rpcbasic_register_get<my_pfb_clock_sync_mc, uint64_t>(
+	      alias(), "zero output calls",
+	      &my_pfb_clock_sync_mc::zero_output_calls,
+	      pmt::from_uint64(0), pmt::from_uint64(~0ULL), pmt::from_uint64(0),
+	      "calls", "Calls that produced no symbol", RPC_PRIVLVL_MIN,
+              DISPTIME | DISPOPTSTRIP)));
+
+      add_rpc_variable(
+          rpcbasic_sptr(new rpcbasic_register_get<my_pfb_clock_sync_mc, uint64_t>(
+	      alias(), "retunes",
+	      &my_pfb_clock_sync_mc::retunes,
+	      pmt::from_uint64(0), pmt::from_uint64(~0ULL), pmt::from_uint64(0),
+	      "", "sps changes applied", RPC_PRIVLVL_MIN,
+              DISPTIME | DISPOPTSTRIP)));
+
+      add_rpc_variable(
+          rpcbasic_sptr(new rpcbasic_register_get<my_pfb_clock_sync_mc, uint64_t>(
+	      alias(), "banks designed",
+	      &my_pfb_clock_sync_mc::banks_designed,
+	      pmt::from_uint64(0), pmt::from_uint64(~0ULL), pmt::from_uint64(0),
+	      "", "Filterbanks designed", RPC_PRIVLVL_MIN,
+              DISPTIME | DISPOPTSTRIP)));
+
+      add_rpc_variable(
+          rpcbasic_sptr(new rpcbasic_register_get<my_pfb_clock_sync_mc, double>(
+	      alias(), "design time",
+	      &my_pfb_clock_sync_mc::design_time,
+	      pmt::mp(0.0), pmt::mp(1e9), pmt::mp(0.0),
+	      "s", "Time spent designing filterbanks", RPC_PRIVLVL_MIN,
+              DISPTIME | DISPOPTSTRIP)));
+#endif /* GR_CTRLPORT */
+    }
+
+  } /* namespace cbmc */
+} /* namespace gr */
@@ -0,0 +1,144 @@
+/* -*- c++ -*- */
+/* 
+ * Copyright 2016 <+YOU OR YOUR COMPANY+>.
+ * 
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ * 
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+
+
+#ifndef INCLUDED_CBMC_MY_PFB_CLOCK_SYNC_MC_IMPL_H
+#define INCLUDED_CBMC_MY_PFB_CLOCK_SYNC_MC_IMPL_H
+
+#include <cbmc/my_pfb_clock_sync_mc.h>
+#include "my_pfb_clock_sync_impl.h"
+
+namespace gr {
+  namespace cbmc {
+
+    class my_pfb_clock_sync_mc_impl : public my_pfb_clock_sync_mc
+    {
+    public:
+      // Largest sps accepted by set_sps, bounds the history
+      static const int d_max_sps = 50;
+      // sps is quantized to 1/d_sps_quant for the bank and the cache
+      // key, as in my_pfb_clock_sync_impl
+      static const int d_sps_quant = 1000;
+
+    private:
+      // Number of designed banks kept for reuse
+      static const unsigned int d_bank_cache_size = 8;
+
+      // Loop state of one channel
+      struct channel_state
+      {
+	float k;
+	float rate_f;
+	float error;
+      };
+
+      int              d_nchans;
+      sample_format    d_format;
+      int              d_nfilters;
+      double           d_sps;
+      float            d_loop_bw;
+      float            d_damping;
+      float            d_alpha;
+      float            d_beta;
+      float            d_rate;
+      int              d_rate_i;
+      float            d_max_dev;
+      rrc_params       d_rrc;
+      filter_bank_sptr d_bank;       // shared by all channels
+      int              d_taps_per_filter;
+      std::vector<channel_state> d_chans;
+
+      // Least recently used last, guarded by d_cache_mutex since set_sps
+      // designs outside of d_setlock
+      std::list< std::pair<long, filter_bank_sptr> > d_bank_cache;
+      gr::thread::mutex d_cache_mutex;
+
+      // Performance counters
+      perf_counter     d_pc_symbols;
+      perf_counter     d_pc_work_ns;
+      perf_counter     d_pc_idle;
+      perf_counter     d_pc_retunes;
+      perf_counter     d_pc_designs;
+      perf_counter     d_pc_design_ns;
+
+      static int checked_nchannels(int nchannels);
+      void update_gains();
+      void retune(double sps, bool keep_rate);
+      filter_bank_sptr find_cached_bank(long key);
+      void cache_bank(long key, filter_bank_sptr bank);
+      int required_input(int nsymbols) const;
+      int work_channel(channel_state &st, int noutput_items,
+		       const void *in, gr_complex *out,
+		       int ninput, int &count);
+
+    public:
+      my_pfb_clock_sync_mc_impl(int nchannels, double sps, float loop_bw,
+				unsigned int filter_size, float init_phase,
+				float max_rate_deviation, float rolloff,
+				float span, int window, sample_format format);
+      ~my_pfb_clock_sync_mc_impl();
+
+      void forecast(int noutput_items, gr_vector_int &ninput_items_required);
+
+      // Runs the loop of channel c on a buffer outside of the
+      // scheduler, for blocks that embed it. Like ninput_items, ninput
+      // counts the history() - 1 items in front of the new ones; count
+      // is advanced by the items consumed, at most the new ones.
+      int run_channel(int c, int nsymbols, const void *in, gr_complex *out,
+		      int ninput, int &count)
+      {
+	return work_channel(d_chans[c], nsymbols, in, out, ninput, count);
+      }
+
+      void set_sps(double sps);
+
+      // set_sps for callers that follow an sps estimate. When the bank
+      // is cached the estimate only moved among recent values, so the
+      // rate the loops track beyond the nominal one is kept.
+      void follow_sps(double sps);
+      void set_loop_bandwidth(float bw);
+      void set_max_rate_deviation(float m);
+      void reset_counters();
+
+      void setup_rpc();
+
+      int nchannels() const;
+      float loop_bandwidth() const;
+      float error(int channel) const;
+      float rate(int channel) const;
+      float phase(int channel) const;
+      uint64_t symbols_produced() const;
+      double work_time() const;
+      uint64_t zero_output_calls() const;
+      uint64_t retunes() const;
+      uint64_t banks_designed() const;
+      double design_time() const;
+
+      int general_work(int noutput_items,
+		       gr_vector_int &ninput_items,
+		       gr_vector_const_void_star &input_items,
+		       gr_vector_void_star &output_items);
+    };
+
+  } /* namespace cbmc */
+} /* namespace gr */
+
+#endif /* INCLUDED_CBMC_MY_PFB_CLOCK_SYNC_MC_IMPL_H */
@@ -0,0 +1,70 @@
+/* -*- c++ -*- */
+/* 
+ * Copyright 2016 <+YOU OR YOUR COMPANY+>.
+ * 
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ * 
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef INCLUDED_CBMC_PERF_COUNTERS_H
+#define INCLUDED_CBMC_PERF_COUNTERS_H
+
+#include <gnuradio/high_res_timer.h>
+#include <boost/atomic.hpp>
+#include <stdint.h>
+
+namespace gr {
+  namespace cbmc {
+
+    /*!
+     * Event count or time in ns, updated by the work or design thread
+     * and read through the getters and ControlPort from any thread.
+     */
+    class perf_counter
+    {
+    public:
+      perf_counter() : d_value(0) {}
+
+      void add(uint64_t n = 1) { d_value.fetch_add(n, boost::memory_order_relaxed); }
+      void reset() { d_value.store(0, boost::memory_order_relaxed); }
+      uint64_t value() const { return d_value.load(boost::memory_order_relaxed); }
+      double seconds() const { return value() * 1e-9; }
+
+    private:
+      boost::atomic<uint64_t> d_value;
+    };
+
+    /*!
+     * Adds the time from construction to destruction to a counter.
+     */
+    class perf_timer
+    {
+    public:
+      perf_timer(perf_counter &ns) : d_ns(ns), d_start(gr::high_res_timer_now()) {}
+      ~perf_timer()
+      {
+	gr::high_res_timer_type ticks = gr::high_res_timer_now() - d_start;
+	d_ns.add((uint64_t)(ticks * (1e9 / gr::high_res_timer_tps())));
+      }
+
+    private:
+      perf_counter          &d_ns;
+      gr::high_res_timer_type d_start;
+    };
+
+  } /* namespace cbmc */
+} /* namespace gr */
+
+#endif /* INCLUDED_CBMC_PERF_COUNTERS_H */
@@ -0,0 +1,194 @@
+/* -*- c++ -*- */
+/* 
+ * Copyright 2016 <+YOU OR YOUR COMPANY+>.
+ * 
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ * 
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef INCLUDED_CBMC_PROBE_BUFFER_H
+#define INCLUDED_CBMC_PROBE_BUFFER_H
+
+#include <boost/atomic.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <algorithm>
+#include <vector>
+#include <stdint.h>
+
+namespace gr {
+  namespace cbmc {
+
+    /*!
+     * Fixed capacity ring of probe values, written by the work thread
+     * and read by getters from any thread.
+     *
+     * push() is wait-free and never allocates; when the ring is full
+     * the value is dropped and counted in overflows(), so memory stays
+     * constant however long the flowgraph runs. The readers take a
+     * mutex among themselves only, the writer never waits for them.
+     */
+    template<class T>
+    class probe_buffer : boost::noncopyable
+    {
+    public:
+      explicit probe_buffer(size_t capacity)
+	: d_buf(capacity + 1), d_head(0), d_tail(0), d_overflows(0)
+      {}
+
+      // Writer side
+      void push(const T &value)
+      {
+	const size_t head = d_head.load(boost::memory_order_relaxed);
+	const size_t next = (head + 1 == d_buf.size()) ? 0 : head + 1;
+	if(next == d_tail.load(boost::memory_order_acquire)) {
+	  d_overflows.fetch_add(1, boost::memory_order_relaxed);
+	  return;
+	}
+	d_buf[head] = value;
+	d_head.store(next, boost::memory_order_release);
+      }
+
+      // Reader side: copies the stored values, oldest first
+      std::vector<T> snapshot() const
+      {
+	boost::mutex::scoped_lock lock(d_read_mutex);
+	std::vector<T> out;
+	copy(out, d_tail.load(boost::memory_order_relaxed),
+	     d_head.load(boost::memory_order_acquire));
+	return out;
+      }
+
+      // Reader side: removes and returns the stored values
+      std::vector<T> drain()
+      {
+	boost::mutex::scoped_lock lock(d_read_mutex);
+	std::vector<T> out;
+	const size_t head = d_head.load(boost::memory_order_acquire);
+	copy(out, d_tail.load(boost::memory_order_relaxed), head);
+	d_tail.store(head, boost::memory_order_release);
+	return out;
+      }
+
+      // Reader side: moves up to max values into out, returns their number
+      size_t drain(T *out, size_t max)
+      {
+	boost::mutex::scoped_lock lock(d_read_mutex);
+	const size_t head = d_head.load(boost::memory_order_acquire);
+	size_t tail = d_tail.load(boost::memory_order_relaxed);
+	size_t n = 0;
+	while(tail != head && n < max) {
+	  size_t chunk = std::min(max - n, ((head >= tail) ? head : d_buf.size()) - tail);
+	  std::copy(d_buf.begin() + tail, d_buf.begin() + tail + chunk, out + n);
+	  n += chunk;
+	  tail += chunk;
+	  if(tail == d_buf.size()) {
+	    tail = 0;
+	  }
+	}
+	d_tail.store(tail, boost::memory_order_release);
+	return n;
+      }
+
+      // Reader side: snapshot() and drain() of one member of the
+      // stored values, for rings of structs whose members are read
+      // separately. Draining a member removes the whole values. The
+      // class of the member is deduced, so that rings of scalars
+      // still instantiate.
+      template<class U, class C>
+      std::vector<U> snapshot(U C::*member) const
+      {
+	std::vector<T> values = snapshot();
+	return project(values, member);
+      }
+
+      template<class U, class C>
+      std::vector<U> drain(U C::*member)
+      {
+	std::vector<T> values = drain();
+	return project(values, member);
+      }
+
+      // Reader side: drain(out, max) of one member, allocates nothing
+      template<class U, class C>
+      size_t drain(U *out, size_t max, U C::*member)
+      {
+	boost::mutex::scoped_lock lock(d_read_mutex);
+	const size_t head = d_head.load(boost::memory_order_acquire);
+	size_t tail = d_tail.load(boost::memory_order_relaxed);
+	size_t n = 0;
+	while(tail != head && n < max) {
+	  out[n++] = d_buf[tail].*member;
+	  if(++tail == d_buf.size()) {
+	    tail = 0;
+	  }
+	}
+	d_tail.store(tail, boost::memory_order_release);
+	return n;
+      }
+
+      // Reader side: drops the stored values
+      void clear()
+      {
+	boost::mutex::scoped_lock lock(d_read_mutex);
+	d_tail.store(d_head.load(boost::memory_order_acquire),
+		     boost::memory_order_release);
+      }
+
+      size_t size() const
+      {
+	const size_t head = d_head.load(boost::memory_order_acquire);
+	const size_t tail = d_tail.load(boost::memory_order_acquire);
+	return (head >= tail) ? head - tail : head + d_buf.size() - tail;
+      }
+
+      size_t capacity() const { return d_buf.size() - 1; }
+      uint64_t overflows() const { return d_overflows.load(boost::memory_order_relaxed); }
+      void reset_overflows() { d_overflows.store(0, boost::memory_order_relaxed); }
+
+    private:
+      template<class U, class C>
+      static std::vector<U> project(const std::vector<T> &values, U C::*member)
+      {
+	std::vector<U> out(values.size());
+	for(size_t i = 0; i < values.size(); i++) {
+	  out[i] = values[i].*member;
+	}
+	return out;
+      }
+
+      void copy(std::vector<T> &out, size_t tail, size_t head) const
+      {
+	if(head >= tail) {
+	  out.assign(d_buf.begin() + tail, d_buf.begin() + head);
+	}
+	else {
+	  out.assign(d_buf.begin() + tail, d_buf.end());
+	  out.insert(out.end(), d_buf.begin(), d_buf.begin() + head);
+	}
+      }
+
+      // One slot stays free to tell a full ring from an empty one
+      std::vector<T>         d_buf;
+      boost::atomic<size_t>  d_head;       // next slot to write
+      boost::atomic<size_t>  d_tail;       // oldest stored value
+      boost::atomic<uint64_t> d_overflows;
+      mutable boost::mutex   d_read_mutex;
+    };
+
+  } /* namespace cbmc */
+} /* namespace gr */
+
+#endif /* INCLUDED_CBMC_PROBE_BUFFER_H */
@@ -26,11 +26,23 @@
  */
 
 #include "qa_cbmc.h"
+#include "qa_freq_sps_det.h"
+#include "qa_kernels.h"
+#include "qa_modulation_classifier.h"
+#include "qa_my_pfb_clock_sync.h"
+#include "qa_probe_buffer.h"
+#include "qa_receiver.h"
 
 CppUnit::TestSuite *
 qa_cbmc::suite()
 {
   CppUnit::TestSuite *s = new CppUnit::TestSuite("cbmc");
+  s->addTest(gr::cbmc::qa_freq_sps_det::suite());
+  s->addTest(gr::cbmc::qa_kernels::suite());
+  s->addTest(gr::cbmc::qa_modulation_classifier::suite());
+  s->addTest(gr::cbmc::qa_my_pfb_clock_sync::suite());
+  s->addTest(gr::cbmc::qa_probe_buffer::suite());
+  s->addTest(gr::cbmc::qa_receiver::suite());
 
   return s;
 }
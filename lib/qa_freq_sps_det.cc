@@ -0,0 +1,107 @@
+/* -*- c++ -*- */
+/* 
+ * Copyright 2016 <+YOU OR YOUR COMPANY+>.
+ * 
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ * 
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "qa_freq_sps_det.h"
+#include "qa_golden.h"
+#include "freq_sps_det_impl.h"
+#include <cppunit/TestAssert.h>
+#include <cmath>
+#include <sstream>
+
+namespace gr {
+  namespace cbmc {
+
+    /*
+     * Frequency offset and sps of RRC shaped bpsk and qpsk. The
+     * estimates have to be near the true values and equal to the
+     * recorded ones: with decimation 4096 and nsubdiv 4 a frequency bin
+     * of the refined search is 1.5e-5 or less.
+     */
+    void
+    qa_freq_sps_det::t_estimates()
+    {
+      const int decim = 4096;
+      const char *mods[] = {"bpsk", "qpsk"};
+      const int spss[] = {4, 8};
+      const double offsets[] = {-0.01, 0.005, 0.02};
+
+      boost::shared_ptr<freq_sps_det_impl> det =
+	gnuradio::get_initial_sptr(new freq_sps_det_impl(decim, 4, 0));
+
+      std::vector<float> freqs, spsv;
+      for(int m = 0; m < 2; m++) {
+	for(int s = 0; s < 2; s++) {
+	  for(int f = 0; f < 3; f++) {
+	    std::vector<gr_complex> x =
+	      golden::shape_rrc(golden::symbols(mods[m], decim / spss[s] + 1, 1), spss[s]);
+	    golden::impair(x, offsets[f], 0.05, 2);
+
+	    float f_offset, sps;
+	    det->calc_f_offset_and_sps(f_offset, sps, &x[0]);
+
+	    std::ostringstream what;
+	    what << mods[m] << " sps " << spss[s] << " offset " << offsets[f];
+	    CPPUNIT_ASSERT_DOUBLES_EQUAL_MESSAGE(what.str(), offsets[f], f_offset, 1e-3);
+	    CPPUNIT_ASSERT_DOUBLES_EQUAL_MESSAGE(what.str(), spss[s], sps, 0.1 * spss[s]);
+
+	    freqs.push_back(f_offset);
+	    spsv.push_back(sps);
+	  }
+	}
+      }
+
+      golden::check("freq_sps_det_f_offset", freqs, 1e-5);
+      golden::check("freq_sps_det_sps", spsv, 1e-3);
+    }
+
+    /*
+     * Shifting a tone by its own frequency leaves a constant, also
+     * across calls, which carry the phase over.
+     */
+    void
+    qa_freq_sps_det::t_shift()
+    {
+      const int decim = 1000;
+      const float f = 0.0123;
+
+      boost::shared_ptr<freq_sps_det_impl> det =
+	gnuradio::get_initial_sptr(new freq_sps_det_impl(decim, 1, 0));
+
+      std::vector<gr_complex> tone(2 * decim);
+      for(unsigned int i = 0; i < tone.size(); i++) {
+	tone[i] = std::polar(1.0, 2 * M_PI * f * (i + 1));
+      }
+
+      std::vector<gr_complex> out(2 * decim);
+      det->f_shift_samples(&out[0], &tone[0], f);
+      det->f_shift_samples(&out[decim], &tone[decim], f);
+
+      for(unsigned int i = 0; i < out.size(); i++) {
+	CPPUNIT_ASSERT_DOUBLES_EQUAL(1.0, out[i].real(), 1e-3);
+	CPPUNIT_ASSERT_DOUBLES_EQUAL(0.0, out[i].imag(), 1e-3);
+      }
+    }
+
+  } /* namespace cbmc */
+} /* namespace gr */
@@ -0,0 +1,214 @@
+/* -*- c++ -*- */
+/* 
+ * Copyright 2016 <+YOU OR YOUR COMPANY+>.
+ * 
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ * 
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "qa_golden.h"
+#include "rng.h"
+#include <gnuradio/filter/firdes.h>
+#include <cppunit/TestAssert.h>
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+#ifndef CBMC_GOLDEN_DIR
+#define CBMC_GOLDEN_DIR "golden"
+#endif
+
+namespace gr {
+  namespace cbmc {
+    namespace golden {
+
+      static std::vector<gr_complex>
+      constellation(const std::string &mod)
+      {
+	std::vector<gr_complex> c;
+	if(mod == "bpsk") {
+	  c.push_back(1);
+	  c.push_back(-1);
+	}
+	else if(mod == "qpsk") {
+	  for(int i = 0; i < 4; i++) {
+	    c.push_back(std::polar(1.0f, (float)(M_PI/4 + M_PI/2*i)));
+	  }
+	}
+	else if(mod == "8psk") {
+	  for(int i = 0; i < 8; i++) {
+	    c.push_back(std::polar(1.0f, (float)(M_PI/4*i)));
+	  }
+	}
+	else if(mod == "16qam") {
+	  for(int i = -3; i <= 3; i += 2) {
+	    for(int q = -3; q <= 3; q += 2) {
+	      c.push_back(gr_complex(i, q) / std::sqrt(10.0f));
+	    }
+	  }
+	}
+	else {
+	  CPPUNIT_FAIL("unknown modulation " + mod);
+	}
+	return c;
+      }
+
+      std::vector<gr_complex>
+      symbols(const std::string &mod, int nsymbols, unsigned int seed)
+      {
+	std::vector<gr_complex> c = constellation(mod);
+	rng r(seed);
+	std::vector<gr_complex> out(nsymbols);
+	for(int i = 0; i < nsymbols; i++) {
+	  out[i] = c[r.integer(c.size())];
+	}
+	return out;
+      }
+
+      std::vector<gr_complex>
+      upsample(const std::vector<gr_complex> &syms, double sps)
+      {
+	int n = (int)(syms.size() * sps);
+	std::vector<gr_complex> out(n);
+	for(int i = 0; i < n; i++) {
+	  out[i] = syms[std::min((size_t)(i / sps), syms.size() - 1)];
+	}
+	return out;
+      }
+
+      std::vector<gr_complex>
+      shape_rrc(const std::vector<gr_complex> &syms, int sps)
+      {
+	std::vector<float> taps =
+	  gr::filter::firdes::root_raised_cosine(sps, sps, 1.0, 0.35, 11*sps);
+
+	// Filter delay removed, so symbol i peaks at sample i*sps
+	int delay = taps.size() / 2;
+	int n = syms.size() * sps;
+	std::vector<gr_complex> out(n);
+	for(unsigned int i = 0; i < syms.size(); i++) {
+	  for(unsigned int k = 0; k < taps.size(); k++) {
+	    int j = i*sps + k - delay;
+	    if(j >= 0 && j < n) {
+	      out[j] += syms[i] * taps[k];
+	    }
+	  }
+	}
+	return out;
+      }
+
+      void
+      impair(std::vector<gr_complex> &samples, double f_offset,
+	     double noise, unsigned int seed)
+      {
+	rng r(seed);
+	for(unsigned int i = 0; i < samples.size(); i++) {
+	  double ph = 2 * M_PI * f_offset * i;
+	  samples[i] *= gr_complex(std::cos(ph), std::sin(ph));
+	  samples[i] += gr_complex(noise * r.gauss(), noise * r.gauss());
+	}
+      }
+
+      gr_complex
+      slice(const std::string &mod, gr_complex x)
+      {
+	std::vector<gr_complex> c = constellation(mod);
+	gr_complex best = c[0];
+	for(unsigned int i = 1; i < c.size(); i++) {
+	  if(std::norm(x - c[i]) < std::norm(x - best)) {
+	    best = c[i];
+	  }
+	}
+	return best;
+      }
+
+      double
+      evm(const std::string &mod, const gr_complex *samples, int n)
+      {
+	double power = 0;
+	for(int i = 0; i < n; i++) {
+	  power += std::norm(samples[i]);
+	}
+	float scale = 1.0 / std::sqrt(power / n);
+
+	double err = 0;
+	for(int i = 0; i < n; i++) {
+	  gr_complex x = samples[i] * scale;
+	  err += std::norm(x - slice(mod, x));
+	}
+	return std::sqrt(err / n);
+      }
+
+      void
+      check(const std::string &name, const std::vector<float> &values,
+	    double tolerance)
+      {
+	const char *dir = getenv("CBMC_GOLDEN_DIR");
+	std::string path = std::string(dir ? dir : CBMC_GOLDEN_DIR) + "/" + name + ".txt";
+
+	if(getenv("CBMC_GOLDEN_RECORD")) {
+	  std::ofstream out(path.c_str());
+	  CPPUNIT_ASSERT_MESSAGE("cannot write " + path, out.good());
+	  out.precision(9);
+	  for(unsigned int i = 0; i < values.size(); i++) {
+	    out << values[i] << "\n";
+	  }
+	  std::cerr << "recorded " << path << std::endl;
+	  return;
+	}
+
+	std::ifstream in(path.c_str());
+	CPPUNIT_ASSERT_MESSAGE("no reference " + path + ", see lib/golden/README", in.good());
+
+	// strtod, since operator>> does not read inf and nan
+	std::vector<float> ref;
+	std::string token;
+	while(in >> token) {
+	  ref.push_back(strtod(token.c_str(), NULL));
+	}
+
+	CPPUNIT_ASSERT_EQUAL_MESSAGE(name + ": number of values", ref.size(), values.size());
+	for(unsigned int i = 0; i < ref.size(); i++) {
+	  bool same = ref[i] == values[i] || (std::isnan(ref[i]) && std::isnan(values[i]));
+	  if(!same && !(std::abs(ref[i] - values[i]) <= tolerance)) {
+	    std::ostringstream msg;
+	    msg << name << "[" << i << "] = " << values[i]
+		<< ", reference " << ref[i] << ", tolerance " << tolerance;
+	    CPPUNIT_FAIL(msg.str());
+	  }
+	}
+      }
+
+      std::vector<float>
+      flatten(const std::vector<gr_complex> &samples)
+      {
+	std::vector<float> out(2 * samples.size());
+	for(unsigned int i = 0; i < samples.size(); i++) {
+	  out[2*i] = samples[i].real();
+	  out[2*i+1] = samples[i].imag();
+	}
+	return out;
+      }
+
+    } /* namespace golden */
+  } /* namespace cbmc */
+} /* namespace gr */
@@ -0,0 +1,78 @@
+/* -*- c++ -*- */
+/* 
+ * Copyright 2016 <+YOU OR YOUR COMPANY+>.
+ * 
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ * 
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef _QA_GOLDEN_H_
+#define _QA_GOLDEN_H_
+
+#include <gnuradio/gr_complex.h>
+#include <string>
+#include <vector>
+
+namespace gr {
+  namespace cbmc {
+    namespace golden {
+
+      /*!
+       * Reproducible test signals and the reference values recorded
+       * from them.
+       *
+       * A reference is a text file in lib/golden, one value per line,
+       * see lib/golden/README for where the values come from. check()
+       * compares against it with an absolute tolerance and fails if it
+       * is missing. Only with CBMC_GOLDEN_RECORD set in the environment
+       * the values are written instead. CBMC_GOLDEN_DIR overrides the
+       * directory.
+       */
+
+      //! Unit power symbols of "bpsk", "qpsk", "8psk" or "16qam"
+      std::vector<gr_complex> symbols(const std::string &mod, int nsymbols,
+				      unsigned int seed);
+
+      //! Rectangular pulses of sps samples
+      std::vector<gr_complex> upsample(const std::vector<gr_complex> &syms,
+				       double sps);
+
+      //! Root raised cosine pulses, rolloff 0.35, integer sps
+      std::vector<gr_complex> shape_rrc(const std::vector<gr_complex> &syms,
+					int sps);
+
+      //! Frequency offset in cycles per sample and complex white noise
+      //! of the given standard deviation per component
+      void impair(std::vector<gr_complex> &samples, double f_offset,
+		  double noise, unsigned int seed);
+
+      //! Nearest point of the unit power constellation
+      gr_complex slice(const std::string &mod, gr_complex x);
+
+      //! RMS error vector of samples against slice(), after scaling
+      //! them to unit power
+      double evm(const std::string &mod, const gr_complex *samples, int n);
+
+      //! Compare against, or record, the reference of this name
+      void check(const std::string &name, const std::vector<float> &values,
+		 double tolerance);
+
+      std::vector<float> flatten(const std::vector<gr_complex> &samples);
+
+    } /* namespace golden */
+  } /* namespace cbmc */
+} /* namespace gr */
+
+#endif /* _QA_GOLDEN_H_ */
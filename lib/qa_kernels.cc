@@ -0,0 +1,132 @@
+/* -*- c++ -*- */
+/* 
+ * Copyright 2016 <+YOU OR YOUR COMPANY+>.
+ * 
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ * 
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "qa_kernels.h"
+#include "kernels.h"
+#include <cppunit/TestAssert.h>
+#include <complex>
+#include <cmath>
+
+namespace gr {
+  namespace cbmc {
+
+    typedef std::complex<double> complexd;
+
+    // Lengths around the block and lane sizes of the kernels
+    static const int lengths[] = {1, 7, 8, 63, 64, 65, 1000};
+
+    static std::vector<gr_complex>
+    signal(int n, float phase)
+    {
+      std::vector<gr_complex> x(n);
+      for(int i = 0; i < n; i++) {
+	x[i] = std::polar(1.0f + 0.2f * std::sin(0.7f * i), phase * i);
+      }
+      return x;
+    }
+
+    static void
+    select_all(const std::string &arch)
+    {
+      std::vector<std::string> names = kernels::kernel_names();
+      for(unsigned int k = 0; k < names.size(); k++) {
+	CPPUNIT_ASSERT(kernels::select(names[k], arch));
+      }
+    }
+
+    /*
+     * Every implementation this CPU supports against std::pow in double.
+     */
+    void
+    qa_kernels::t_power()
+    {
+      std::vector<std::string> archs = kernels::arch_names();
+      for(unsigned int a = 0; a < archs.size(); a++) {
+	select_all(archs[a]);
+	for(unsigned int l = 0; l < sizeof(lengths)/sizeof(lengths[0]); l++) {
+	  const int n = lengths[l];
+	  std::vector<gr_complex> x = signal(n, 0.37f), y(n);
+	  for(int r = 2; r <= 8; r *= 2) {
+	    kernels::power(&y[0], &x[0], r, n);
+	    complexd ref_sum = 0;
+	    for(int i = 0; i < n; i++) {
+	      complexd ref = std::pow(complexd(x[i]), r);
+	      ref_sum += ref;
+	      CPPUNIT_ASSERT_DOUBLES_EQUAL(ref.real(), y[i].real(), 1e-4 * std::abs(ref) + 1e-6);
+	      CPPUNIT_ASSERT_DOUBLES_EQUAL(ref.imag(), y[i].imag(), 1e-4 * std::abs(ref) + 1e-6);
+	    }
+	    gr_complex s = kernels::power_sum(&x[0], r, n);
+	    CPPUNIT_ASSERT_DOUBLES_EQUAL(ref_sum.real(), s.real(), 1e-4 * n);
+	    CPPUNIT_ASSERT_DOUBLES_EQUAL(ref_sum.imag(), s.imag(), 1e-4 * n);
+
+	    // In place, as the estimators chain it
+	    std::vector<gr_complex> z = x;
+	    kernels::power(&z[0], &z[0], r, n);
+	    for(int i = 0; i < n; i++) {
+	      CPPUNIT_ASSERT_DOUBLES_EQUAL(0, std::abs(z[i] - y[i]), 1e-5 * std::abs(y[i]));
+	    }
+	  }
+	}
+      }
+      std::vector<gr_complex> x = signal(8, 0.37f);
+      CPPUNIT_ASSERT_THROW(kernels::power_sum(&x[0], 3, 8), std::invalid_argument);
+
+      // Back to the most specific implementation
+      select_all(archs.back());
+    }
+
+    void
+    qa_kernels::t_reductions()
+    {
+      std::vector<std::string> archs = kernels::arch_names();
+      for(unsigned int a = 0; a < archs.size(); a++) {
+	select_all(archs[a]);
+	for(unsigned int l = 0; l < sizeof(lengths)/sizeof(lengths[0]); l++) {
+	  const int n = lengths[l];
+	  std::vector<gr_complex> x = signal(n, 0.37f);
+	  std::vector<gr_complex> y = signal(n, -1.1f);
+	  complexd sum = 0, dot = 0, dot_conj = 0;
+	  for(int i = 0; i < n; i++) {
+	    sum += complexd(x[i]);
+	    dot += complexd(x[i]) * complexd(y[i]);
+	    dot_conj += complexd(x[i]) * std::conj(complexd(y[i]));
+	  }
+	  gr_complex s = kernels::sum(&x[0], n);
+	  gr_complex d = kernels::dot(&x[0], &y[0], n);
+	  gr_complex dc = kernels::dot_conj(&x[0], &y[0], n);
+	  CPPUNIT_ASSERT_DOUBLES_EQUAL(sum.real(), s.real(), 1e-5 * n);
+	  CPPUNIT_ASSERT_DOUBLES_EQUAL(sum.imag(), s.imag(), 1e-5 * n);
+	  CPPUNIT_ASSERT_DOUBLES_EQUAL(dot.real(), d.real(), 1e-5 * n);
+	  CPPUNIT_ASSERT_DOUBLES_EQUAL(dot.imag(), d.imag(), 1e-5 * n);
+	  CPPUNIT_ASSERT_DOUBLES_EQUAL(dot_conj.real(), dc.real(), 1e-5 * n);
+	  CPPUNIT_ASSERT_DOUBLES_EQUAL(dot_conj.imag(), dc.imag(), 1e-5 * n);
+	}
+      }
+
+      // Back to the most specific implementation
+      select_all(archs.back());
+    }
+
+  } /* namespace cbmc */
+} /* namespace gr */
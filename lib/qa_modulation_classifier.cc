@@ -0,0 +1,116 @@
+/* -*- c++ -*- */
+/* 
+ * Copyright 2016 <+YOU OR YOUR COMPANY+>.
+ * 
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ * 
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "qa_modulation_classifier.h"
+#include "qa_golden.h"
+#include "modulation_classifier_impl.h"
+#include <gnuradio/top_block.h>
+#include <gnuradio/blocks/vector_source_c.h>
+#include <gnuradio/blocks/null_sink.h>
+#include <cppunit/TestAssert.h>
+#include <cmath>
+
+namespace gr {
+  namespace cbmc {
+
+    static const char *mods[] = {"8psk", "16qam", "qpsk", "bpsk"};   // by index
+    static const float c40[] = {0, 0.68, 1, 2};                    // |C40|
+
+    /*
+     * |C40| of symbol spaced signals at 23 dB SNR with a phase offset,
+     * the decision, the SNR estimate and the derotated samples.
+     */
+    void
+    qa_modulation_classifier::t_cumulants()
+    {
+      const int decim = 4096;
+
+      boost::shared_ptr<modulation_classifier_impl> mc =
+	gnuradio::get_initial_sptr(new modulation_classifier_impl(decim, true, 4));
+
+      std::vector<float> cumu, decisions, snrs;
+      std::vector<gr_complex> shifted;
+      std::vector<gr_complex> out(decim);
+      for(unsigned int m = 0; m < 4; m++) {
+	std::vector<gr_complex> x = golden::symbols(mods[m], decim, 3);
+	golden::impair(x, 0, 0.05, 4);
+	for(int i = 0; i < decim; i++) {
+	  x[i] *= std::polar(1.0f, 0.3f);
+	}
+
+	float snr;
+	unsigned int det = mc->detMod2(&out[0], snr, &x[0]);
+
+	CPPUNIT_ASSERT_EQUAL_MESSAGE(mods[m], m, det);
+	CPPUNIT_ASSERT_DOUBLES_EQUAL_MESSAGE(mods[m], c40[m], mc->get_stored_cumu().back(), 0.15);
+
+	cumu.push_back(mc->get_stored_cumu().back());
+	decisions.push_back(det);
+	snrs.push_back(snr);
+	shifted.insert(shifted.end(), out.begin(), out.begin() + 64);
+      }
+
+      golden::check("modulation_classifier_c40", cumu, 1e-4);
+      golden::check("modulation_classifier_decision", decisions, 0);
+      golden::check("modulation_classifier_snr", snrs, 1e-2);
+      golden::check("modulation_classifier_shifted", golden::flatten(shifted), 1e-4);
+    }
+
+    /*
+     * The block decides once per decimation items, in order.
+     */
+    void
+    qa_modulation_classifier::t_work()
+    {
+      const int decim = 1000;
+
+      std::vector<gr_complex> x;
+      for(unsigned int m = 0; m < 4; m++) {
+	std::vector<gr_complex> s = golden::symbols(mods[m], decim, 5 + m);
+	x.insert(x.end(), s.begin(), s.end());
+      }
+      golden::impair(x, 0, 0.05, 9);
+
+      gr::top_block_sptr tb = gr::make_top_block("qa_modulation_classifier");
+      gr::blocks::vector_source_c::sptr src = gr::blocks::vector_source_c::make(x);
+      modulation_classifier::sptr mc = modulation_classifier::make(decim, true);
+      gr::blocks::null_sink::sptr sink = gr::blocks::null_sink::make(sizeof(gr_complex));
+      tb->connect(src, 0, mc, 0);
+      tb->connect(mc, 0, sink, 0);
+      tb->run();
+
+      std::vector<unsigned int> det = mc->get_stored_mod();
+      CPPUNIT_ASSERT_EQUAL((size_t)4, det.size());
+      for(unsigned int m = 0; m < 4; m++) {
+	CPPUNIT_ASSERT_EQUAL_MESSAGE(mods[m], m, det[m]);
+      }
+
+      // One entry per block holds both values, draining one drains both
+      CPPUNIT_ASSERT_EQUAL((size_t)4, mc->get_stored_cumu().size());
+      CPPUNIT_ASSERT_EQUAL((size_t)4, mc->drain_stored_cumu().size());
+      CPPUNIT_ASSERT(mc->get_stored_mod().empty());
+    }
+
+  } /* namespace cbmc */
+} /* namespace gr */
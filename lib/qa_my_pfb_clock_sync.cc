@@ -0,0 +1,648 @@
+/* -*- c++ -*- */
+/* 
+ * Copyright 2016 <+YOU OR YOUR COMPANY+>.
+ * 
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ * 
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "qa_my_pfb_clock_sync.h"
+#include "qa_golden.h"
+#include "my_pfb_clock_sync_impl.h"
+#include <cbmc/my_pfb_clock_sync_mc.h>
+#include <gnuradio/top_block.h>
+#include <gnuradio/blocks/vector_source_c.h>
+#include <gnuradio/blocks/vector_source_s.h>
+#include <gnuradio/blocks/vector_sink_c.h>
+#include <gnuradio/blocks/vector_sink_f.h>
+#include <gnuradio/blocks/null_sink.h>
+#include <cppunit/TestAssert.h>
+#include <cmath>
+#include <sstream>
+#include <stdexcept>
+
+namespace gr {
+  namespace cbmc {
+
+    static const int nsymbols = 4000;
+    static const int tail = 1000;     // symbols after acquisition
+    static const int nrecorded = 256; // symbols compared to the reference
+
+    // The references come from the filterbank before the optimizations,
+    // see lib/golden/README. A rounding difference in the loop state
+    // can pick the neighbouring arm for a symbol, 1/32 symbol apart,
+    // which moves that output by up to 0.015.
+    static const double sync_tolerance = 2e-2;
+
+    static std::vector<gr_complex>
+    test_symbols()
+    {
+      return golden::symbols("qpsk", nsymbols, 7);
+    }
+
+    // QPSK at 4 sps, a quarter symbol late, 20 dB SNR
+    static std::vector<gr_complex>
+    test_signal()
+    {
+      std::vector<gr_complex> x = golden::shape_rrc(test_symbols(), 4);
+      golden::impair(x, 0, 0.05, 8);
+      x.erase(x.begin());
+      return x;
+    }
+
+    // Offset d of the output that decodes as syms[i] at out[d+i], over
+    // the symbols [first, last) of syms
+    static int
+    align(const std::vector<gr_complex> &out, const std::vector<gr_complex> &syms,
+	  int first, int last, int maxoffset)
+    {
+      int best = 0, nbest = -1;
+      for(int d = 0; d <= maxoffset; d++) {
+	int n = 0;
+	for(int i = first; i < last && d + i < (int)out.size(); i++) {
+	  n += (golden::slice("qpsk", out[d+i]) == syms[i]);
+	}
+	if(n > nbest) {
+	  best = d;
+	  nbest = n;
+	}
+      }
+      return best;
+    }
+
+    // The outputs of the symbols [first, first+n) of syms. They are
+    // located by align(), so the recorded values do not move with the
+    // history of the block.
+    static std::vector<gr_complex>
+    window(const std::vector<gr_complex> &out, const std::vector<gr_complex> &syms,
+	   int first, int n)
+    {
+      int d = align(out, syms, first, first + n, 100);
+      CPPUNIT_ASSERT(d + first + n <= (int)out.size());
+      return std::vector<gr_complex>(out.begin() + d + first, out.begin() + d + first + n);
+    }
+
+    static double
+    l1(const std::vector<float> &taps)
+    {
+      double s = 0;
+      for(unsigned int i = 0; i < taps.size(); i++) {
+	s += std::abs(taps[i]);
+      }
+      return s;
+    }
+
+    /*
+     * filter_fused() against filter() and filter_diff() on every arm.
+     */
+    void
+    qa_my_pfb_clock_sync::t_filter_fused()
+    {
+      const double spss[] = {2, 4, 8};
+      const int nfilters = 32;
+
+      for(int s = 0; s < 3; s++) {
+	rrc_params rrc;
+	rrc.rolloff = 0.35;
+	rrc.span = 0;
+	rrc.window = -1;
+	filter_bank_sptr bank = filter_bank::make_pfb(nfilters, rrc.prototype(nfilters, spss[s]));
+	std::vector<gr_complex> in = test_signal();
+
+	for(int arm = 0; arm < nfilters; arm++) {
+	  gr_complex out, dout;
+	  bank->filter_fused(arm, &in[100], out, dout);
+
+	  double tol = 1e-5 * l1(bank->arm_taps(arm)) + 1e-6;
+	  double dtol = 1e-5 * l1(bank->arm_diff_taps(arm)) + 1e-6;
+	  gr_complex ref = bank->filter(arm, &in[100]);
+	  gr_complex dref = bank->filter_diff(arm, &in[100]);
+	  CPPUNIT_ASSERT_DOUBLES_EQUAL(ref.real(), out.real(), tol);
+	  CPPUNIT_ASSERT_DOUBLES_EQUAL(ref.imag(), out.imag(), tol);
+	  CPPUNIT_ASSERT_DOUBLES_EQUAL(dref.real(), dout.real(), dtol);
+	  CPPUNIT_ASSERT_DOUBLES_EQUAL(dref.imag(), dout.imag(), dtol);
+	}
+      }
+    }
+
+    /*
+     * filter_fused_q15() against filter_fused() on the same sc16
+     * samples, within the bound documented in my_pfb_clock_sync_mc.h.
+     */
+    void
+    qa_my_pfb_clock_sync::t_filter_q15()
+    {
+      const double spss[] = {2, 4, 8};
+      const float spans[] = {0, 8};
+      const int nfilters = 32;
+
+      for(int s = 0; s < 3; s++) {
+	for(int m = 0; m < 2; m++) {
+	  rrc_params rrc;
+	  rrc.rolloff = 0.35;
+	  rrc.span = spans[m];
+	  rrc.window = spans[m] > 0 ? 0 : -1;
+	  filter_bank_sptr bank = filter_bank::make_pfb(nfilters, rrc.prototype(nfilters, spss[s]));
+	  bank->quantize();
+
+	  // Half scale, so the noise peaks stay below full scale
+	  std::vector<gr_complex> x = test_signal();
+	  int n = bank->taps_per_filter + 8;
+	  std::vector<short> qin(2 * n);
+	  std::vector<gr_complex> in(n);
+	  for(int i = 0; i < n; i++) {
+	    qin[2*i] = (short)lrintf(std::max(-1.0f, std::min(0.999f, 0.5f * x[i].real())) * 32768);
+	    qin[2*i+1] = (short)lrintf(std::max(-1.0f, std::min(0.999f, 0.5f * x[i].imag())) * 32768);
+	    in[i] = gr_complex(qin[2*i], qin[2*i+1]) / 32768.0f;
+	  }
+
+	  double tol = bank->taps_per_filter * 32768.0 * bank->qgain / 2 + 1e-6;
+	  double dtol = bank->taps_per_filter * 32768.0 * bank->qdgain / 2 + 1e-6;
+	  for(int arm = 0; arm < nfilters; arm++) {
+	    gr_complex out, dout, ref, dref;
+	    bank->filter_fused_q15(arm, &qin[0], out, dout);
+	    bank->filter_fused(arm, &in[0], ref, dref);
+
+	    std::ostringstream what;
+	    what << "sps " << spss[s] << " span " << spans[m] << " arm " << arm;
+	    CPPUNIT_ASSERT_DOUBLES_EQUAL_MESSAGE(what.str(), ref.real(), out.real(), tol);
+	    CPPUNIT_ASSERT_DOUBLES_EQUAL_MESSAGE(what.str(), ref.imag(), out.imag(), tol);
+	    CPPUNIT_ASSERT_DOUBLES_EQUAL_MESSAGE(what.str(), dref.real(), dout.real(), dtol);
+	    CPPUNIT_ASSERT_DOUBLES_EQUAL_MESSAGE(what.str(), dref.imag(), dout.imag(), dtol);
+	  }
+	}
+      }
+    }
+
+    /*
+     * The block locks to the symbol timing: one output per symbol with
+     * a small error vector, equal to the recorded output.
+     */
+    void
+    qa_my_pfb_clock_sync::t_clock_sync()
+    {
+      gr::top_block_sptr tb = gr::make_top_block("qa_my_pfb_clock_sync");
+      gr::blocks::vector_source_c::sptr src = gr::blocks::vector_source_c::make(test_signal());
+      my_pfb_clock_sync::sptr sync = my_pfb_clock_sync::make(4, 6.28/100, 32, 16, 1.5, 1, 4096);
+      gr::blocks::vector_sink_c::sptr sink = gr::blocks::vector_sink_c::make();
+      tb->connect(src, 0, sync, 0);
+      tb->connect(sync, 0, sink, 0);
+      tb->run();
+
+      std::vector<gr_complex> out = sink->data();
+      CPPUNIT_ASSERT(out.size() > nsymbols - 100 && out.size() <= nsymbols);
+      CPPUNIT_ASSERT(golden::evm("qpsk", &out[out.size() - tail], tail) < 0.2);
+
+      std::vector<gr_complex> syms = test_symbols();
+      golden::check("my_pfb_clock_sync_out",
+		    golden::flatten(window(out, syms, nsymbols - 2*nrecorded, nrecorded)),
+		    sync_tolerance);
+    }
+
+    /*
+     * Every interpolator, timing error detector and output rate locks
+     * to the symbol timing of the test signal, with the lock threshold
+     * of t_clock_lock. With two outputs per symbol the symbols are the
+     * even outputs.
+     */
+    void
+    qa_my_pfb_clock_sync::t_clock_sync_variants()
+    {
+      struct variant {
+	interp_type interp;
+	ted_type ted;
+	int osps;
+      };
+      const variant variants[] = {
+	{INTERP_CUBIC, TED_ML, 1},
+	{INTERP_PFB, TED_GARDNER, 1},
+	{INTERP_PFB, TED_MUELLER_MULLER, 1},
+	{INTERP_CUBIC, TED_GARDNER, 1},
+	{INTERP_PFB, TED_ML, 2},
+	{INTERP_CUBIC, TED_ML, 2},
+	{INTERP_PFB, TED_GARDNER, 2},
+	{INTERP_PFB, TED_MUELLER_MULLER, 2}
+      };
+
+      for(unsigned int v = 0; v < sizeof(variants) / sizeof(variants[0]); v++) {
+	const variant &t = variants[v];
+	my_pfb_clock_sync::sptr sync =
+	  my_pfb_clock_sync::make(4, 6.28/100, 32, 16, 1.5, t.osps, 4096, t.interp, t.ted);
+	sync->set_lock_threshold(0.02);
+	gr::top_block_sptr tb = gr::make_top_block("qa_my_pfb_clock_sync_variants");
+	gr::blocks::vector_source_c::sptr src = gr::blocks::vector_source_c::make(test_signal());
+	gr::blocks::vector_sink_c::sptr sink = gr::blocks::vector_sink_c::make();
+	tb->connect(src, 0, sync, 0);
+	tb->connect(sync, 0, sink, 0);
+	tb->run();
+
+	std::vector<gr_complex> out = sink->data(), syms;
+	for(unsigned int i = 0; i < out.size(); i += t.osps) {
+	  syms.push_back(out[i]);
+	}
+	CPPUNIT_ASSERT(syms.size() > nsymbols - 100 && syms.size() <= nsymbols);
+	CPPUNIT_ASSERT(golden::evm("qpsk", &syms[syms.size() - tail], tail) < 0.2);
+
+	// Locked within the acquisition and still locked at the end
+	std::vector<tag_t> tags = sink->tags();
+	size_t n = 0;
+	while(n < tags.size() && !pmt::eq(tags[n].key, pmt::intern("clock_lock"))) {
+	  n++;
+	}
+	CPPUNIT_ASSERT(n < tags.size() && pmt::to_bool(tags[n].value));
+	CPPUNIT_ASSERT(tags[n].offset < (uint64_t)(t.osps * 1000));
+	CPPUNIT_ASSERT(sync->locked());
+      }
+    }
+
+    /*
+     * The lock detector tags the first lock on the signal and the loss
+     * of lock when only noise follows. The threshold is close to the
+     * error variance of the signal, so without the hysteresis the
+     * lock would come and go during the signal.
+     */
+    void
+    qa_my_pfb_clock_sync::t_clock_lock()
+    {
+      std::vector<gr_complex> x = test_signal();
+      std::vector<gr_complex> noise(4 * 2000);
+      golden::impair(noise, 0, 2.0, 9);
+      x.insert(x.end(), noise.begin(), noise.end());
+
+      my_pfb_clock_sync::sptr sync = my_pfb_clock_sync::make(4, 6.28/100, 32, 16, 1.5, 1, 4096);
+      sync->set_lock_threshold(0.02);
+      gr::top_block_sptr tb = gr::make_top_block("qa_my_pfb_clock_sync_lock");
+      gr::blocks::vector_source_c::sptr src = gr::blocks::vector_source_c::make(x);
+      gr::blocks::vector_sink_c::sptr sink = gr::blocks::vector_sink_c::make();
+      tb->connect(src, 0, sync, 0);
+      tb->connect(sync, 0, sink, 0);
+      tb->run();
+
+      std::vector<tag_t> all = sink->tags(), tags;
+      for(size_t i = 0; i < all.size(); i++) {
+	if(pmt::eq(all[i].key, pmt::intern("clock_lock"))) {
+	  tags.push_back(all[i]);
+	}
+      }
+
+      // Locked after the first 64 symbols, unlocked in the noise
+      int nsignal = nsymbols + (sync->history() - 1) / 4;
+      CPPUNIT_ASSERT_EQUAL((size_t)2, tags.size());
+      CPPUNIT_ASSERT(pmt::to_bool(tags[0].value));
+      CPPUNIT_ASSERT(tags[0].offset >= 64 && tags[0].offset < 1000);
+      CPPUNIT_ASSERT(!pmt::to_bool(tags[1].value));
+      CPPUNIT_ASSERT(tags[1].offset > (uint64_t)nsignal - 50 && tags[1].offset < (uint64_t)nsignal + 500);
+    }
+
+    /*
+     * Fed in small chunks the block gives the same symbols as in one
+     * large call, so no call reads past the input it was given.
+     */
+    void
+    qa_my_pfb_clock_sync::t_chunked()
+    {
+      std::vector<gr_complex> out[2];
+      for(int run = 0; run < 2; run++) {
+	gr::top_block_sptr tb = gr::make_top_block("qa_my_pfb_clock_sync_chunked");
+	gr::blocks::vector_source_c::sptr src = gr::blocks::vector_source_c::make(test_signal());
+	if(run == 1) {
+	  src->set_max_noutput_items(37);
+	}
+	my_pfb_clock_sync::sptr sync = my_pfb_clock_sync::make(4, 6.28/100, 32, 16, 1.5, 1, 4096);
+	gr::blocks::vector_sink_c::sptr sink = gr::blocks::vector_sink_c::make();
+	tb->connect(src, 0, sync, 0);
+	tb->connect(sync, 0, sink, 0);
+	tb->run();
+	out[run] = sink->data();
+      }
+
+      CPPUNIT_ASSERT(out[0].size() > nsymbols - 100);
+      CPPUNIT_ASSERT_EQUAL(out[0].size(), out[1].size());
+      for(size_t i = 0; i < out[0].size(); i++) {
+	CPPUNIT_ASSERT(out[0][i] == out[1][i]);
+      }
+    }
+
+    /*
+     * Channels of my_pfb_clock_sync_mc do not influence each other, and
+     * the sc16 path locks as well as the float one.
+     */
+    void
+    qa_my_pfb_clock_sync::t_multichannel()
+    {
+      // Both formats get the same half scale samples, the loop gain
+      // depends on the amplitude
+      std::vector<gr_complex> x = test_signal();
+      std::vector<short> q(2 * x.size());
+      for(unsigned int i = 0; i < x.size(); i++) {
+	q[2*i] = (short)lrintf(std::max(-1.0f, std::min(0.999f, 0.5f * x[i].real())) * 32768);
+	q[2*i+1] = (short)lrintf(std::max(-1.0f, std::min(0.999f, 0.5f * x[i].imag())) * 32768);
+	x[i] = gr_complex(q[2*i], q[2*i+1]) / 32768.0f;
+      }
+
+      std::vector<gr_complex> out[2][2];
+      for(int format = 0; format < 2; format++) {
+	gr::top_block_sptr tb = gr::make_top_block("qa_my_pfb_clock_sync_mc");
+	my_pfb_clock_sync_mc::sptr sync =
+	  my_pfb_clock_sync_mc::make(2, 4, 6.28/100, 32, 16, 1.5, 0.35, 0, -1,
+				     (sample_format)format);
+	gr::blocks::vector_sink_c::sptr sinks[2];
+	for(int ch = 0; ch < 2; ch++) {
+	  if(format == SAMPLES_SC16) {
+	    tb->connect(gr::blocks::vector_source_s::make(q, false, 2), 0, sync, ch);
+	  }
+	  else {
+	    tb->connect(gr::blocks::vector_source_c::make(x), 0, sync, ch);
+	  }
+	  sinks[ch] = gr::blocks::vector_sink_c::make();
+	  tb->connect(sync, ch, sinks[ch], 0);
+	}
+	tb->run();
+
+	for(int ch = 0; ch < 2; ch++) {
+	  out[format][ch] = sinks[ch]->data();
+	  CPPUNIT_ASSERT(out[format][ch].size() > nsymbols - 100);
+	}
+	CPPUNIT_ASSERT(out[format][0] == out[format][1]);
+      }
+
+      double evm = golden::evm("qpsk", &out[0][0][out[0][0].size() - tail], tail);
+      double evm_q15 = golden::evm("qpsk", &out[1][0][out[1][0].size() - tail], tail);
+      CPPUNIT_ASSERT(evm < 0.2);
+      CPPUNIT_ASSERT_DOUBLES_EQUAL(evm, evm_q15, 0.03);
+
+      std::vector<gr_complex> syms = test_symbols();
+      golden::check("my_pfb_clock_sync_mc_out",
+		    golden::flatten(window(out[0][0], syms, nsymbols - 2*nrecorded, nrecorded)),
+		    sync_tolerance);
+      golden::check("my_pfb_clock_sync_mc_sc16_out",
+		    golden::flatten(window(out[1][0], syms, nsymbols - 2*nrecorded, nrecorded)),
+		    sync_tolerance);
+    }
+
+    /*
+     * Going back to an sps seen before uses its cached filterbank: no
+     * new design, and the same taps as the first time. The same for
+     * my_pfb_clock_sync_mc.
+     */
+    void
+    qa_my_pfb_clock_sync::t_bank_cache()
+    {
+      boost::shared_ptr<my_pfb_clock_sync_impl> sync =
+	gnuradio::get_initial_sptr(new my_pfb_clock_sync_impl(4, 6.28/100, 32, 16, 1.5, 1, 4096));
+      std::vector< std::vector<float> > taps4 = sync->taps();
+      uint64_t designed = sync->banks_designed();
+
+      sync->set_sps(5);
+      CPPUNIT_ASSERT_EQUAL(designed + 1, sync->banks_designed());
+      CPPUNIT_ASSERT(sync->taps() != taps4);
+
+      sync->set_sps(4);
+      CPPUNIT_ASSERT_EQUAL(designed + 1, sync->banks_designed());
+      CPPUNIT_ASSERT(sync->taps() == taps4);
+
+      // The same sps up to the quantization of the cache key
+      sync->set_sps(5.0001);
+      CPPUNIT_ASSERT_EQUAL(designed + 1, sync->banks_designed());
+
+      // The multichannel block keeps its own cache
+      my_pfb_clock_sync_mc::sptr mc =
+	my_pfb_clock_sync_mc::make(2, 4, 6.28/100, 32, 16, 1.5);
+      designed = mc->banks_designed();
+      mc->set_sps(5);
+      mc->set_sps(4);
+      mc->set_sps(5.0001);
+      CPPUNIT_ASSERT_EQUAL(designed + 1, mc->banks_designed());
+      CPPUNIT_ASSERT_EQUAL((uint64_t)4, mc->retunes());
+
+      CPPUNIT_ASSERT_THROW(my_pfb_clock_sync_mc::make(0, 4, 6.28/100), std::out_of_range);
+    }
+
+    /*
+     * A "det_sps" tag retunes from 4 to 5 sps where the signal changes
+     * its symbol rate. Every symbol of both parts is decoded at the
+     * output position the input samples give it, so no samples were
+     * skipped or read twice by the retune.
+     */
+    void
+    qa_my_pfb_clock_sync::t_retune()
+    {
+      const int n1 = 1000, n2 = 1000;
+      std::vector<gr_complex> s1 = golden::symbols("qpsk", n1, 21);
+      std::vector<gr_complex> s2 = golden::symbols("qpsk", n2, 22);
+      std::vector<gr_complex> x = golden::shape_rrc(s1, 4);
+      std::vector<gr_complex> x2 = golden::shape_rrc(s2, 5);
+      x.insert(x.end(), x2.begin(), x2.end());
+      golden::impair(x, 0, 0.02, 23);
+
+      std::vector<tag_t> tags(1);
+      tags[0].offset = 4 * n1;
+      tags[0].key = pmt::intern("det_sps");
+      tags[0].value = pmt::from_double(5.0);
+
+      // Both banks designed up front, the retune uses the cached one
+      // right away. One symbol per call and a short tag search range
+      // retune at the symbol boundary next to the tag.
+      boost::shared_ptr<my_pfb_clock_sync_impl> sync =
+	gnuradio::get_initial_sptr(new my_pfb_clock_sync_impl(5, 6.28/100, 32, 16, 1.5, 1, 4));
+      sync->set_sps(4);
+      sync->set_max_latency(1);
+
+      gr::top_block_sptr tb = gr::make_top_block("qa_my_pfb_clock_sync_retune");
+      gr::blocks::vector_source_c::sptr src = gr::blocks::vector_source_c::make(x, false, 1, tags);
+      gr::blocks::vector_sink_c::sptr sink = gr::blocks::vector_sink_c::make();
+      tb->connect(src, 0, sync, 0);
+      tb->connect(sync, 0, sink, 0);
+      tb->run();
+
+      std::vector<gr_complex> out = sink->data();
+      std::vector<gr_complex> syms(s1);
+      syms.insert(syms.end(), s2.begin(), s2.end());
+
+      int lead = (sync->history() - 1) / 4;
+      int d1 = align(out, syms, 200, n1 - 50, 2 * lead);
+      int d2 = align(out, syms, n1 + 100, n1 + n2 - 50, 2 * lead);
+      CPPUNIT_ASSERT_EQUAL(d1, d2);
+
+      int errors = 0;
+      for(int i = n1 + 100; i < n1 + n2 - 50; i++) {
+	errors += (golden::slice("qpsk", out[d2+i]) != syms[i]);
+      }
+      CPPUNIT_ASSERT_EQUAL(0, errors);
+
+      // The constructor, set_sps() and the tag
+      CPPUNIT_ASSERT_EQUAL((uint64_t)3, sync->retunes());
+    }
+
+    static double
+    state_sps(my_pfb_clock_sync::sptr sync)
+    {
+      return pmt::to_double(pmt::dict_ref(sync->loop_state(), pmt::mp("sps"), pmt::PMT_NIL));
+    }
+
+    static void
+    run_block(my_pfb_clock_sync::sptr sync, const std::vector<gr_complex> &x)
+    {
+      gr::top_block_sptr tb = gr::make_top_block("qa_my_pfb_clock_sync_state");
+      gr::blocks::vector_source_c::sptr src = gr::blocks::vector_source_c::make(x);
+      gr::blocks::vector_sink_c::sptr sink = gr::blocks::vector_sink_c::make();
+      tb->connect(src, 0, sync, 0);
+      tb->connect(sync, 0, sink, 0);
+      tb->run();
+    }
+
+    /*
+     * A saved loop state restores into another block: right away
+     * with a cached bank, with saved taps once they are designed in
+     * the background. Bad states are rejected by set_loop_state() and
+     * ignored on "state_in".
+     */
+    void
+    qa_my_pfb_clock_sync::t_loop_state()
+    {
+      my_pfb_clock_sync::sptr a = my_pfb_clock_sync::make(4, 6.28/100, 32, 16, 1.5, 1, 4096);
+      a->set_lock_threshold(0.05);
+      run_block(a, test_signal());
+      pmt::pmt_t st = a->loop_state();
+      CPPUNIT_ASSERT(pmt::to_bool(pmt::dict_ref(st, pmt::mp("locked"), pmt::PMT_F)));
+
+      // Without taps: the bank of sps 4 is cached in b
+      const char *keys[] = { "sps", "phase", "rate", "locked" };
+      pmt::pmt_t loop = pmt::make_dict();
+      for(int k = 0; k < 4; k++) {
+	loop = pmt::dict_add(loop, pmt::mp(keys[k]), pmt::dict_ref(st, pmt::mp(keys[k]), pmt::PMT_NIL));
+      }
+      my_pfb_clock_sync::sptr b = my_pfb_clock_sync::make(4, 6.28/100, 32, 16, 1.5, 1, 4096);
+      b->set_loop_state(loop);
+      pmt::pmt_t restored = b->loop_state();
+      for(int k = 0; k < 4; k++) {
+	CPPUNIT_ASSERT(pmt::equal(pmt::dict_ref(st, pmt::mp(keys[k]), pmt::PMT_NIL),
+				  pmt::dict_ref(restored, pmt::mp(keys[k]), pmt::PMT_NIL)));
+      }
+
+      // Keys of the wrong type or range
+      pmt::pmt_t bad[3];
+      bad[0] = pmt::dict_add(loop, pmt::mp("sps"), pmt::mp("four"));
+      bad[1] = pmt::dict_add(loop, pmt::mp("locked"), pmt::from_long(1));
+      bad[2] = pmt::dict_add(loop, pmt::mp("sps"), pmt::from_double(1000));
+      for(int k = 0; k < 3; k++) {
+	CPPUNIT_ASSERT_THROW(b->set_loop_state(bad[k]), std::invalid_argument);
+      }
+      CPPUNIT_ASSERT(pmt::equal(restored, b->loop_state()));
+
+      // With taps: c starts at 5 sps and takes over the saved bank
+      // once it is designed, at most a few runs later
+      std::vector<gr_complex> x = test_signal();
+      x.resize(2000);
+      my_pfb_clock_sync::sptr c = my_pfb_clock_sync::make(5, 6.28/100, 32, 16, 1.5, 1, 4096);
+      c->set_loop_state(st);
+      for(int n = 0; n < 100 && state_sps(c) != 4; n++) {
+	run_block(c, x);
+      }
+      CPPUNIT_ASSERT_EQUAL(4.0, state_sps(c));
+      CPPUNIT_ASSERT(pmt::equal(pmt::dict_ref(st, pmt::mp("taps"), pmt::PMT_NIL),
+				pmt::dict_ref(c->loop_state(), pmt::mp("taps"), pmt::PMT_NIL)));
+
+      // A bad state on the port neither throws nor changes the sps
+      pmt::pmt_t to5 = pmt::dict_add(bad[1], pmt::mp("sps"), pmt::from_double(5));
+      c->_post(pmt::mp("state_in"), to5);
+      run_block(c, x);
+      CPPUNIT_ASSERT_EQUAL(4.0, state_sps(c));
+    }
+
+    /*
+     * Setters publish their parameters and general_work takes them
+     * over at the next symbol boundary: the getters answer at once,
+     * and every symbol of the next run uses the new telemetry
+     * decimation.
+     */
+    void
+    qa_my_pfb_clock_sync::t_mailbox()
+    {
+      my_pfb_clock_sync::sptr sync = my_pfb_clock_sync::make(4, 6.28/100, 32, 16, 1.5, 1, 4096);
+      std::vector<gr_complex> x = test_signal();
+      std::vector<gr_complex> part[2];
+      part[0].assign(x.begin(), x.begin() + x.size() / 2);
+      part[1].assign(x.begin() + x.size() / 2, x.end());
+
+      size_t nsym[2], ntelem[2];
+      for(int run = 0; run < 2; run++) {
+	if(run == 1) {
+	  sync->set_telemetry_decimation(4);
+	  sync->set_max_latency(16);
+	  CPPUNIT_ASSERT_EQUAL(4, sync->telemetry_decimation());
+	  CPPUNIT_ASSERT_EQUAL(16, sync->max_latency());
+	}
+
+	gr::top_block_sptr tb = gr::make_top_block("qa_my_pfb_clock_sync_mailbox");
+	gr::blocks::vector_source_c::sptr src = gr::blocks::vector_source_c::make(part[run]);
+	gr::blocks::vector_sink_c::sptr sink = gr::blocks::vector_sink_c::make();
+	gr::blocks::vector_sink_f::sptr err = gr::blocks::vector_sink_f::make();
+	gr::blocks::null_sink::sptr null = gr::blocks::null_sink::make(sizeof(float));
+	tb->connect(src, 0, sync, 0);
+	tb->connect(sync, 0, sink, 0);
+	tb->connect(sync, 1, err, 0);
+	tb->connect(sync, 2, null, 0);
+	tb->connect(sync, 3, null, 1);
+	tb->run();
+
+	nsym[run] = sink->data().size();
+	ntelem[run] = err->data().size();
+      }
+      CPPUNIT_ASSERT_EQUAL(nsym[0], ntelem[0]);
+      CPPUNIT_ASSERT_EQUAL(nsym[1] / 4, ntelem[1]);
+
+      // The acquisition bandwidth leaves the tracking gains alone
+      sync->set_alpha(0.5);
+      sync->set_acquisition_bandwidth(0.1);
+      CPPUNIT_ASSERT_DOUBLES_EQUAL(0.5, sync->alpha(), 1e-6);
+    }
+
+    /*
+     * taps_into() and diff_taps_into() give taps() and diff_taps()
+     * flattened, and write nothing into a short buffer.
+     */
+    void
+    qa_my_pfb_clock_sync::t_taps_into()
+    {
+      my_pfb_clock_sync::sptr sync = my_pfb_clock_sync::make(4, 6.28/100, 32, 16, 1.5, 1, 4096);
+      std::vector< std::vector<float> > taps = sync->taps();
+      std::vector< std::vector<float> > dtaps = sync->diff_taps();
+      std::vector<int> shape = sync->taps_shape();
+      CPPUNIT_ASSERT_EQUAL((int)taps.size(), shape[0]);
+      CPPUNIT_ASSERT_EQUAL((int)taps[0].size(), shape[1]);
+
+      const size_t n = shape[0] * shape[1];
+      std::vector<float> flat(n), dflat(n);
+      CPPUNIT_ASSERT_EQUAL(n, sync->taps_into(&flat[0], n));
+      CPPUNIT_ASSERT_EQUAL(n, sync->diff_taps_into(&dflat[0], n));
+      for(int i = 0; i < shape[0]; i++) {
+	for(int j = 0; j < shape[1]; j++) {
+	  CPPUNIT_ASSERT_EQUAL(taps[i][j], flat[i*shape[1] + j]);
+	  CPPUNIT_ASSERT_EQUAL(dtaps[i][j], dflat[i*shape[1] + j]);
+	}
+      }
+
+      std::vector<float> shortbuf(n - 1, -1);
+      CPPUNIT_ASSERT_EQUAL(n, sync->taps_into(&shortbuf[0], n - 1));
+      CPPUNIT_ASSERT_EQUAL(-1.0f, shortbuf[0]);
+    }
+
+  } /* namespace cbmc */
+} /* namespace gr */
@@ -0,0 +1,66 @@
+/* -*- c++ -*- */
+/* 
+ * Copyright 2016 <+YOU OR YOUR COMPANY+>.
+ * 
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ * 
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef _QA_MY_PFB_CLOCK_SYNC_H_
+#define _QA_MY_PFB_CLOCK_SYNC_H_
+
+#include <cppunit/extensions/HelperMacros.h>
+#include <cppunit/TestCase.h>
+
+namespace gr {
+  namespace cbmc {
+
+    class qa_my_pfb_clock_sync : public CppUnit::TestCase
+    {
+    public:
+      CPPUNIT_TEST_SUITE(qa_my_pfb_clock_sync);
+      CPPUNIT_TEST(t_filter_fused);
+      CPPUNIT_TEST(t_filter_q15);
+      CPPUNIT_TEST(t_clock_sync);
+      CPPUNIT_TEST(t_clock_sync_variants);
+      CPPUNIT_TEST(t_chunked);
+      CPPUNIT_TEST(t_clock_lock);
+      CPPUNIT_TEST(t_multichannel);
+      CPPUNIT_TEST(t_bank_cache);
+      CPPUNIT_TEST(t_retune);
+      CPPUNIT_TEST(t_loop_state);
+      CPPUNIT_TEST(t_mailbox);
+      CPPUNIT_TEST(t_taps_into);
+      CPPUNIT_TEST_SUITE_END();
+
+    private:
+      void t_filter_fused();
+      void t_filter_q15();
+      void t_clock_sync();
+      void t_clock_sync_variants();
+      void t_chunked();
+      void t_clock_lock();
+      void t_multichannel();
+      void t_bank_cache();
+      void t_retune();
+      void t_loop_state();
+      void t_mailbox();
+      void t_taps_into();
+    };
+
+  } /* namespace cbmc */
+} /* namespace gr */
+
+#endif /* _QA_MY_PFB_CLOCK_SYNC_H_ */
@@ -0,0 +1,127 @@
+/* -*- c++ -*- */
+/* 
+ * Copyright 2016 <+YOU OR YOUR COMPANY+>.
+ * 
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ * 
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "qa_probe_buffer.h"
+#include "probe_buffer.h"
+#include <boost/bind.hpp>
+#include <boost/thread/thread.hpp>
+#include <cppunit/TestAssert.h>
+
+namespace gr {
+  namespace cbmc {
+
+    /*
+     * Overflow, drain and wrap around of a small ring.
+     */
+    void
+    qa_probe_buffer::t_ring()
+    {
+      probe_buffer<int> b(4);
+      CPPUNIT_ASSERT_EQUAL((size_t)4, b.capacity());
+
+      for(int i = 0; i < 6; i++) {
+	b.push(i);
+      }
+      CPPUNIT_ASSERT_EQUAL((size_t)4, b.size());
+      CPPUNIT_ASSERT_EQUAL((uint64_t)2, b.overflows());
+
+      std::vector<int> s = b.snapshot();
+      CPPUNIT_ASSERT_EQUAL((size_t)4, s.size());
+      CPPUNIT_ASSERT_EQUAL(0, s[0]);
+      CPPUNIT_ASSERT_EQUAL(3, s[3]);
+      CPPUNIT_ASSERT_EQUAL((size_t)4, b.size());
+
+      std::vector<int> d = b.drain();
+      CPPUNIT_ASSERT(d == s);
+      CPPUNIT_ASSERT_EQUAL((size_t)0, b.size());
+
+      // Wraps around the end of the storage
+      for(int i = 10; i < 13; i++) {
+	b.push(i);
+      }
+      d = b.drain();
+      CPPUNIT_ASSERT_EQUAL((size_t)3, d.size());
+      CPPUNIT_ASSERT_EQUAL(10, d[0]);
+      CPPUNIT_ASSERT_EQUAL(12, d[2]);
+
+      // Into a buffer in chunks, across the wrap around
+      for(int i = 30; i < 34; i++) {
+	b.push(i);
+      }
+      int out[3];
+      CPPUNIT_ASSERT_EQUAL((size_t)3, b.drain(out, 3));
+      CPPUNIT_ASSERT_EQUAL(30, out[0]);
+      CPPUNIT_ASSERT_EQUAL(32, out[2]);
+      CPPUNIT_ASSERT_EQUAL((size_t)1, b.drain(out, 3));
+      CPPUNIT_ASSERT_EQUAL(33, out[0]);
+      CPPUNIT_ASSERT_EQUAL((size_t)0, b.drain(out, 3));
+
+      b.push(20);
+      b.clear();
+      CPPUNIT_ASSERT(b.snapshot().empty());
+      CPPUNIT_ASSERT_EQUAL((uint64_t)2, b.overflows());
+      b.reset_overflows();
+      CPPUNIT_ASSERT_EQUAL((uint64_t)0, b.overflows());
+    }
+
+    static void
+    push_values(probe_buffer<int> *b, int n)
+    {
+      for(int i = 0; i < n; i++) {
+	b->push(i);
+      }
+    }
+
+    /*
+     * A writer thread against a draining reader: every value is either
+     * read once, in order, or counted as overflow.
+     */
+    void
+    qa_probe_buffer::t_concurrent()
+    {
+      const int n = 200000;
+      probe_buffer<int> b(64);
+
+      boost::thread writer(boost::bind(&push_values, &b, n));
+
+      long nread = 0;
+      int last = -1;
+      bool ordered = true;
+      while(nread + (long)b.overflows() < n) {
+	std::vector<int> d = b.drain();
+	for(unsigned int i = 0; i < d.size(); i++) {
+	  ordered = ordered && d[i] > last;
+	  last = d[i];
+	}
+	nread += d.size();
+      }
+      writer.join();
+
+      CPPUNIT_ASSERT(ordered);
+      CPPUNIT_ASSERT_EQUAL((long)n, nread + (long)b.overflows());
+      CPPUNIT_ASSERT_EQUAL((size_t)0, b.size());
+    }
+
+  } /* namespace cbmc */
+} /* namespace gr */
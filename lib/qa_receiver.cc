@@ -0,0 +1,108 @@
+/* -*- c++ -*- */
+/* 
+ * Copyright 2016 <+YOU OR YOUR COMPANY+>.
+ * 
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ * 
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "qa_receiver.h"
+#include "qa_golden.h"
+#include <cbmc/receiver.h>
+#include <cbmc/freq_sps_det.h>
+#include <cbmc/my_pfb_clock_sync.h>
+#include <cbmc/modulation_classifier.h>
+#include <gnuradio/top_block.h>
+#include <gnuradio/blocks/vector_source_c.h>
+#include <gnuradio/blocks/vector_sink_c.h>
+#include <cppunit/TestAssert.h>
+#include <cmath>
+
+namespace gr {
+  namespace cbmc {
+
+    /*
+     * The fused receiver estimates, synchronizes and classifies like
+     * the chain of separate blocks on the same input.
+     */
+    void
+    qa_receiver::t_against_chain()
+    {
+      const int decim = 4096;
+      const int cls_decim = 500;
+
+      std::vector<gr_complex> x = golden::shape_rrc(golden::symbols("qpsk", 30000, 11), 4);
+      golden::impair(x, 0.005, 0.05, 12);
+
+      gr::top_block_sptr tb = gr::make_top_block("qa_receiver");
+      gr::blocks::vector_source_c::sptr src = gr::blocks::vector_source_c::make(x);
+
+      receiver::sptr rx = receiver::make(decim, 4, 4, 6.28/100, 32, 16, 1.5, cls_decim);
+      gr::blocks::vector_sink_c::sptr sink = gr::blocks::vector_sink_c::make();
+      tb->connect(src, 0, rx, 0);
+      tb->connect(rx, 0, sink, 0);
+
+      freq_sps_det::sptr det = freq_sps_det::make(decim, 4);
+      my_pfb_clock_sync::sptr sync = my_pfb_clock_sync::make(4, 6.28/100, 32, 16, 1.5, 1, decim);
+      modulation_classifier::sptr cls = modulation_classifier::make(cls_decim, true);
+      gr::blocks::vector_sink_c::sptr chain_sink = gr::blocks::vector_sink_c::make();
+      tb->connect(src, 0, det, 0);
+      tb->connect(det, 0, sync, 0);
+      tb->connect(sync, 0, cls, 0);
+      tb->connect(cls, 0, chain_sink, 0);
+
+      tb->run();
+
+      CPPUNIT_ASSERT_DOUBLES_EQUAL(0.005, rx->f_offset(), 1e-3);
+      CPPUNIT_ASSERT_DOUBLES_EQUAL(4.0, rx->sps(), 0.4);
+      CPPUNIT_ASSERT_EQUAL(2u, rx->modulation());
+
+      // Both classify every full block of symbols, as QPSK
+      std::vector<unsigned int> chain = cls->get_stored_mod();
+      uint64_t nblocks = rx->tags_emitted() / 2;
+      CPPUNIT_ASSERT(nblocks > 0);
+      CPPUNIT_ASSERT(nblocks + 1 >= chain.size() && chain.size() + 1 >= nblocks);
+      CPPUNIT_ASSERT_EQUAL((size_t)(nblocks * cls_decim), sink->data().size());
+      for(unsigned int i = 0; i < chain.size(); i++) {
+	CPPUNIT_ASSERT_EQUAL(2u, chain[i]);
+      }
+
+      CPPUNIT_ASSERT_EQUAL((uint64_t)(x.size() / decim), rx->blocks_processed());
+
+      // The symbols are as clean as those of the chain on the last
+      // blocks, after both loops have settled. The classifier turns
+      // QPSK onto the axes, so they are turned back onto the reference
+      // constellation first.
+      std::vector<gr_complex> out = sink->data(), ref = chain_sink->data();
+      const int tail = 4 * cls_decim;
+      CPPUNIT_ASSERT((int)out.size() >= tail && (int)ref.size() >= tail);
+      const gr_complex rot = std::polar(1.0f, (float)(M_PI/4));
+      std::vector<gr_complex> syms(tail), ref_syms(tail);
+      for(int i = 0; i < tail; i++) {
+	syms[i] = out[out.size() - tail + i] * rot;
+	ref_syms[i] = ref[ref.size() - tail + i] * rot;
+      }
+      double evm = golden::evm("qpsk", &syms[0], tail);
+      double evm_chain = golden::evm("qpsk", &ref_syms[0], tail);
+      CPPUNIT_ASSERT(evm < 0.2);
+      CPPUNIT_ASSERT_DOUBLES_EQUAL(evm_chain, evm, 0.02);
+    }
+
+  } /* namespace cbmc */
+} /* namespace gr */
@@ -0,0 +1,406 @@
+/* -*- c++ -*- */
+/* 
+ * Copyright 2016 <+YOU OR YOUR COMPANY+>.
+ * 
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ * 
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <cmath>
+#include <stdexcept>
+
+#include <gnuradio/io_signature.h>
+#include "receiver_impl.h"
+#include <boost/math/special_functions/round.hpp>
+
+namespace gr {
+  namespace cbmc {
+
+    receiver::sptr
+    receiver::make(int decimation, int nsubdiv, double sps, float loop_bw,
+		   unsigned int filter_size,
+		   float init_phase,
+		   float max_rate_deviation,
+		   int classifier_decimation,
+		   float rolloff,
+		   float span,
+		   int window)
+    {
+      return gnuradio::get_initial_sptr
+	(new receiver_impl(decimation, nsubdiv, sps, loop_bw,
+			   filter_size, init_phase, max_rate_deviation,
+			   classifier_decimation, rolloff, span, window));
+    }
+
+    // Drops the items before pos, which were already read
+    static void
+    compact(std::vector<gr_complex> &buf, size_t &pos)
+    {
+      buf.erase(buf.begin(), buf.begin() + pos);
+      pos = 0;
+    }
+
+    receiver_impl::receiver_impl(int decimation, int nsubdiv, double sps,
+				 float loop_bw,
+				 unsigned int filter_size,
+				 float init_phase,
+				 float max_rate_deviation,
+				 int classifier_decimation,
+				 float rolloff,
+				 float span,
+				 int window)
+      : block("receiver",
+	      io_signature::make(1, 1, sizeof(gr_complex)),
+	      io_signature::make(1, 1, sizeof(gr_complex))),
+	d_decimation(decimation), d_cls_decimation(classifier_decimation),
+	d_shifted_pos(0), d_symbols_pos(0),
+	d_f_offset(0), d_sps(sps),
+	d_sps_key(boost::math::lround(sps * my_pfb_clock_sync_mc_impl::d_sps_quant)),
+	d_mod(0), d_snr(0)
+    {
+      if(decimation < 1 || decimation > 65535) {
+	throw std::out_of_range("receiver: invalid decimation. Must be in [1, 65535].");
+      }
+      if(classifier_decimation < 1) {
+	throw std::out_of_range("receiver: invalid classifier decimation. Must be >= 1.");
+      }
+
+      // The stages are called directly, so their probes stay empty
+      d_det = gnuradio::get_initial_sptr(new freq_sps_det_impl(decimation, nsubdiv, 0));
+      d_sync = gnuradio::get_initial_sptr
+	(new my_pfb_clock_sync_mc_impl(1, sps, loop_bw, filter_size, init_phase,
+				       max_rate_deviation, rolloff, span, window,
+				       SAMPLES_FC32));
+      d_cls = gnuradio::get_initial_sptr
+	(new modulation_classifier_impl(classifier_decimation, false, 0));
+
+      // Zeros in front of the first samples, like the history of a block
+      d_shifted.reserve(d_sync->history() - 1 + d_buffer_chunks * d_decimation);
+      d_shifted.assign(d_sync->history() - 1, 0);
+      d_symbols.reserve(d_cls_decimation + d_buffer_chunks * d_decimation);
+
+      set_output_multiple(d_cls_decimation);
+      set_relative_rate(1.0 / sps);
+    }
+
+    receiver_impl::~receiver_impl()
+    {
+    }
+
+    void
+    receiver_impl::forecast(int noutput_items,
+			    gr_vector_int &ninput_items_required)
+    {
+      // Symbols left from the last call are classified without input,
+      // otherwise one chunk is enough to make progress. Asking for more
+      // would strand the last chunks at the end of a stream.
+      if(pending_symbols() >= d_cls_decimation) {
+	ninput_items_required[0] = 0;
+      }
+      else {
+	ninput_items_required[0] = d_decimation;
+      }
+    }
+
+    void
+    receiver_impl::set_loop_bandwidth(float bw)
+    {
+      d_sync->set_loop_bandwidth(bw);
+    }
+
+    void
+    receiver_impl::reset_counters()
+    {
+      d_pc_blocks.reset();
+      d_pc_symbols.reset();
+      d_pc_est_ns.reset();
+      d_pc_loop_ns.reset();
+      d_pc_cls_ns.reset();
+      d_pc_retunes.reset();
+      d_pc_tags.reset();
+    }
+
+    float
+    receiver_impl::loop_bandwidth() const
+    {
+      return d_sync->loop_bandwidth();
+    }
+
+    float
+    receiver_impl::f_offset() const
+    {
+      return d_f_offset;
+    }
+
+    float
+    receiver_impl::sps() const
+    {
+      return d_sps;
+    }
+
+    unsigned int
+    receiver_impl::modulation() const
+    {
+      return d_mod;
+    }
+
+    float
+    receiver_impl::snr() const
+    {
+      return d_snr;
+    }
+
+    uint64_t
+    receiver_impl::blocks_processed() const
+    {
+      return d_pc_blocks.value();
+    }
+
+    uint64_t
+    receiver_impl::symbols_produced() const
+    {
+      return d_pc_symbols.value();
+    }
+
+    double
+    receiver_impl::estimator_time() const
+    {
+      return d_pc_est_ns.seconds();
+    }
+
+    double
+    receiver_impl::loop_time() const
+    {
+      return d_pc_loop_ns.seconds();
+    }
+
+    double
+    receiver_impl::classifier_time() const
+    {
+      return d_pc_cls_ns.seconds();
+    }
+
+    uint64_t
+    receiver_impl::retunes() const
+    {
+      return d_pc_retunes.value();
+    }
+
+    uint64_t
+    receiver_impl::tags_emitted() const
+    {
+      return d_pc_tags.value();
+    }
+
+    int
+    receiver_impl::pending_symbols() const
+    {
+      return d_symbols.size() - d_symbols_pos;
+    }
+
+    // One decimation block through the estimator and the timing loop,
+    // the symbols are appended to d_symbols. Both buffers are read from
+    // an offset and only compacted when the next chunk would not fit
+    // into the reserved space.
+    void
+    receiver_impl::process_chunk(const gr_complex *in)
+    {
+      float sps;
+      {
+	perf_timer timer(d_pc_est_ns);
+	d_det->calc_f_offset_and_sps(d_f_offset, sps, in);
+
+	if(d_shifted.size() + d_decimation > d_shifted.capacity()) {
+	  compact(d_shifted, d_shifted_pos);
+	}
+	size_t nold = d_shifted.size();
+	d_shifted.resize(nold + d_decimation);
+	d_det->f_shift_samples(&d_shifted[nold], in, d_f_offset);
+      }
+
+      // What my_pfb_clock_sync does on a "det_sps" tag, on the sps grid
+      // of the bank cache
+      long key = boost::math::lround(sps * my_pfb_clock_sync_mc_impl::d_sps_quant);
+      if(key != d_sps_key && sps >= 1 && sps < my_pfb_clock_sync_mc_impl::d_max_sps) {
+	d_sync->follow_sps(sps);
+	d_sps = sps;
+	d_sps_key = key;
+	set_relative_rate(1.0 / sps);
+	d_pc_retunes.add();
+      }
+
+      {
+	perf_timer timer(d_pc_loop_ns);
+	int nhist = d_sync->history() - 1;
+	int nlive = d_shifted.size() - d_shifted_pos;
+	int nnew = nlive - nhist;
+
+	if(d_symbols.size() + nnew > d_symbols.capacity()) {
+	  compact(d_symbols, d_symbols_pos);
+	}
+	size_t nsym = d_symbols.size();
+	d_symbols.resize(nsym + nnew);
+	int count = 0;
+	int n = d_sync->run_channel(0, nnew, &d_shifted[d_shifted_pos], &d_symbols[nsym],
+				    nlive, count);
+	d_symbols.resize(nsym + n);
+	d_shifted_pos += count;
+      }
+
+      d_pc_blocks.add();
+    }
+
+    // Classifies and derotates the oldest d_cls_decimation symbols
+    // into out, the first of which is output item offset
+    void
+    receiver_impl::classify(gr_complex *out, uint64_t offset)
+    {
+      // Tag values of modulation_classifier
+      static const char *names[] = {"8PSK", "16AM", "QPSK", "BPSK"};
+
+      perf_timer timer(d_pc_cls_ns);
+      d_mod = d_cls->detMod2(out, d_snr, &d_symbols[d_symbols_pos]);
+      d_symbols_pos += d_cls_decimation;
+
+      add_item_tag(0, offset, pmt::mp("det_mod"), pmt::mp(names[d_mod]));
+      add_item_tag(0, offset, pmt::intern("snr"), pmt::from_float(d_snr));
+      d_pc_tags.add(2);
+    }
+
+    int
+    receiver_impl::general_work(int noutput_items,
+				gr_vector_int &ninput_items,
+				gr_vector_const_void_star &input_items,
+				gr_vector_void_star &output_items)
+    {
+      const gr_complex *in = (const gr_complex *) input_items[0];
+      gr_complex *out = (gr_complex *) output_items[0];
+
+      // Estimate and synchronize a chunk only when the symbols of the
+      // previous ones are out, so d_symbols stays short
+      int nconsumed = 0, nout = 0;
+      while(true) {
+	while(pending_symbols() >= d_cls_decimation &&
+	      nout + d_cls_decimation <= noutput_items) {
+	  classify(out + nout, nitems_written(0) + nout);
+	  nout += d_cls_decimation;
+	}
+
+	if(pending_symbols() >= d_cls_decimation ||
+	   ninput_items[0] - nconsumed < d_decimation) {
+	  break;
+	}
+
+	process_chunk(in + nconsumed);
+	nconsumed += d_decimation;
+      }
+
+      consume_each(nconsumed);
+      d_pc_symbols.add(nout);
+      return nout;
+    }
+
+    void
+    receiver_impl::setup_rpc()
+    {
+#ifdef GR_CTRLPORT
+      add_rpc_variable(
+          rpcbasic_sptr(new rpcbasic_register_get<receiver, float>(
+	      alias(), "f offset",
+	      &receiver::f_offset,
+	      pmt::mp(-0.5f), pmt::mp(0.5f), pmt::mp(0.0f),
+	      "cycles/sample", "Last frequency offset", RPC_PRIVLVL_MIN,
+              DISPTIME | DISPOPTSTRIP)));
+
+      add_rpc_variable(
+          rpcbasic_sptr(new rpcbasic_register_get<receiver, float>(
+	      alias(), "sps",
+	      &receiver::sps,
+	      pmt::mp(0.0f), pmt::mp(50.0f), pmt::mp(0.0f),
+	      "", "Last estimated samples per symbol", RPC_PRIVLVL_MIN,
+              DISPTIME | DISPOPTSTRIP)));
+
+      add_rpc_variable(
+          rpcbasic_sptr(new rpcbasic_register_get<receiver, float>(
+	      alias(), "snr",
+	      &receiver::snr,
+	      pmt::mp(-20.0f), pmt::mp(60.0f), pmt::mp(0.0f),
+	      "dB", "SNR of the last classified block", RPC_PRIVLVL_MIN,
+              DISPTIME | DISPOPTSTRIP)));
+
+      add_rpc_variable(
+          rpcbasic_sptr(new rpcbasic_register_get<receiver, uint64_t>(
+	      alias(), "blocks processed",
+	      &receiver::blocks_processed,
+	      pmt::from_uint64(0), pmt::from_uint64(~0ULL), pmt::from_uint64(0),
+	      "blocks", "Decimation blocks processed", RPC_PRIVLVL_MIN,
+              DISPTIME | DISPOPTSTRIP)));
+
+      add_rpc_variable(
+          rpcbasic_sptr(new rpcbasic_register_get<receiver, uint64_t>(
+	      alias(), "symbols produced",
+	      &receiver::symbols_produced,
+	      pmt::from_uint64(0), pmt::from_uint64(~0ULL), pmt::from_uint64(0),
+	      "symbols", "Symbols produced", RPC_PRIVLVL_MIN,
+              DISPTIME | DISPOPTSTRIP)));
+
+      add_rpc_variable(
+          rpcbasic_sptr(new rpcbasic_register_get<receiver, double>(
+	      alias(), "estimator time",
+	      &receiver::estimator_time,
+	      pmt::mp(0.0), pmt::mp(1e9), pmt::mp(0.0),
+	      "s", "Time spent estimating frequency and sps", RPC_PRIVLVL_MIN,
+              DISPTIME | DISPOPTSTRIP)));
+
+      add_rpc_variable(
+          rpcbasic_sptr(new rpcbasic_register_get<receiver, double>(
+	      alias(), "loop time",
+	      &receiver::loop_time,
+	      pmt::mp(0.0), pmt::mp(1e9), pmt::mp(0.0),
+	      "s", "Time spent in the timing loop", RPC_PRIVLVL_MIN,
+              DISPTIME | DISPOPTSTRIP)));
+
+      add_rpc_variable(
+          rpcbasic_sptr(new rpcbasic_register_get<receiver, double>(
+	      alias(), "classifier time",
+	      &receiver::classifier_time,
+	      pmt::mp(0.0), pmt::mp(1e9), pmt::mp(0.0),
+	      "s", "Time spent classifying", RPC_PRIVLVL_MIN,
+              DISPTIME | DISPOPTSTRIP)));
+
+      add_rpc_variable(
+          rpcbasic_sptr(new rpcbasic_register_get<receiver, uint64_t>(
+	      alias(), "retunes",
+	      &receiver::retunes,
+	      pmt::from_uint64(0), pmt::from_uint64(~0ULL), pmt::from_uint64(0),
+	      "", "sps changes applied", RPC_PRIVLVL_MIN,
+              DISPTIME | DISPOPTSTRIP)));
+
+      add_rpc_variable(
+          rpcbasic_sptr(new rpcbasic_register_get<receiver, uint64_t>(
+	      alias(), "tags emitted",
+	      &receiver::tags_emitted,
+	      pmt::from_uint64(0), pmt::from_uint64(~0ULL), pmt::from_uint64(0),
+	      "tags", "det_mod and snr tags added", RPC_PRIVLVL_MIN,
+              DISPTIME | DISPOPTSTRIP)));
+#endif /* GR_CTRLPORT */
+    }
+
+  } /* namespace cbmc */
+} /* namespace gr */
@@ -0,0 +1,112 @@
+/* -*- c++ -*- */
+/* 
+ * Copyright 2016 <+YOU OR YOUR COMPANY+>.
+ * 
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ * 
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef INCLUDED_CBMC_RECEIVER_IMPL_H
+#define INCLUDED_CBMC_RECEIVER_IMPL_H
+
+#include <cbmc/receiver.h>
+#include "freq_sps_det_impl.h"
+#include "modulation_classifier_impl.h"
+#include "my_pfb_clock_sync_mc_impl.h"
+#include "perf_counters.h"
+
+namespace gr {
+  namespace cbmc {
+
+    /*!
+     * The three stages are the implementation objects of the separate
+     * blocks, called directly and never connected to a flowgraph.
+     */
+    class receiver_impl : public receiver
+    {
+    private:
+      // Chunks the sample and symbol buffers take before the part
+      // already read is dropped
+      static const int d_buffer_chunks = 8;
+
+      const int d_decimation;
+      const int d_cls_decimation;
+
+      boost::shared_ptr<freq_sps_det_impl>          d_det;
+      boost::shared_ptr<my_pfb_clock_sync_mc_impl>  d_sync;
+      boost::shared_ptr<modulation_classifier_impl> d_cls;
+
+      std::vector<gr_complex> d_shifted;  // history of the loop and corrected samples
+      std::vector<gr_complex> d_symbols;  // symbols waiting for classification
+      size_t                  d_shifted_pos;  // first sample not consumed by the loop
+      size_t                  d_symbols_pos;  // first symbol not classified
+
+      float        d_f_offset;
+      float        d_sps;
+      long         d_sps_key;   // d_sps on the grid of the bank cache
+      unsigned int d_mod;
+      float        d_snr;
+
+      // Performance counters
+      perf_counter d_pc_blocks;
+      perf_counter d_pc_symbols;
+      perf_counter d_pc_est_ns;
+      perf_counter d_pc_loop_ns;
+      perf_counter d_pc_cls_ns;
+      perf_counter d_pc_retunes;
+      perf_counter d_pc_tags;
+
+      int pending_symbols() const;
+      void process_chunk(const gr_complex *in);
+      void classify(gr_complex *out, uint64_t offset);
+
+    public:
+      receiver_impl(int decimation, int nsubdiv, double sps, float loop_bw,
+		    unsigned int filter_size, float init_phase,
+		    float max_rate_deviation, int classifier_decimation,
+		    float rolloff, float span, int window);
+      ~receiver_impl();
+
+      void setup_rpc();
+
+      void forecast(int noutput_items, gr_vector_int &ninput_items_required);
+
+      void set_loop_bandwidth(float bw);
+      void reset_counters();
+
+      float loop_bandwidth() const;
+      float f_offset() const;
+      float sps() const;
+      unsigned int modulation() const;
+      float snr() const;
+
+      uint64_t blocks_processed() const;
+      uint64_t symbols_produced() const;
+      double estimator_time() const;
+      double loop_time() const;
+      double classifier_time() const;
+      uint64_t retunes() const;
+      uint64_t tags_emitted() const;
+
+      int general_work(int noutput_items,
+		       gr_vector_int &ninput_items,
+		       gr_vector_const_void_star &input_items,
+		       gr_vector_void_star &output_items);
+    };
+
+  } /* namespace cbmc */
+} /* namespace gr */
+
+#endif /* INCLUDED_CBMC_RECEIVER_IMPL_H */
@@ -0,0 +1,71 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2016 <+YOU OR YOUR COMPANY+>.
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef INCLUDED_CBMC_RNG_H
+#define INCLUDED_CBMC_RNG_H
+
+#include <stdint.h>
+#include <algorithm>
+#include <cmath>
+
+namespace gr {
+  namespace cbmc {
+
+    /*!
+     * Random numbers for the tests and benchmarks, identical on every
+     * platform: xorshift64*, since the std::*_distribution differ
+     * between libraries.
+     */
+    class rng
+    {
+    public:
+      rng(unsigned int seed) : d_state(0x9e3779b97f4a7c15ULL ^ seed) {}
+
+      // [0, 1)
+      double uniform()
+      {
+	d_state ^= d_state >> 12;
+	d_state ^= d_state << 25;
+	d_state ^= d_state >> 27;
+	return ((d_state * 0x2545f4914f6cdd1dULL) >> 11) * (1.0 / 9007199254740992.0);
+      }
+
+      // [0, n)
+      int integer(int n)
+      {
+	return std::min(n - 1, (int)(uniform() * n));
+      }
+
+      // Zero mean, unit variance
+      double gauss()
+      {
+	double u1 = 1.0 - uniform();
+	double u2 = uniform();
+	return std::sqrt(-2.0 * std::log(u1)) * std::cos(2.0 * M_PI * u2);
+      }
+
+    private:
+      uint64_t d_state;
+    };
+
+  } /* namespace cbmc */
+} /* namespace gr */
+
+#endif /* INCLUDED_CBMC_RNG_H */
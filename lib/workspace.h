@@ -0,0 +1,117 @@
+/* -*- c++ -*- */
+/* 
+ * Copyright 2016 <+YOU OR YOUR COMPANY+>.
+ * 
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ * 
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef INCLUDED_CBMC_WORKSPACE_H
+#define INCLUDED_CBMC_WORKSPACE_H
+
+#include <boost/noncopyable.hpp>
+#include <volk/volk.h>
+#include <stdexcept>
+#include <new>
+#include <cstddef>
+
+namespace gr {
+  namespace cbmc {
+
+    /*!
+     * Aligned scratch memory of a block, used as a stack.
+     *
+     * The block sizes it for its largest call chain at construction,
+     * kernels take their temporary arrays with alloc() and hand them
+     * back when their frame goes out of scope:
+     *
+     *   workspace::frame f(d_ws);
+     *   gr_complex *x = d_ws.alloc<gr_complex>(n);
+     *
+     * Every array starts on a volk_get_alignment() boundary, so the
+     * aligned VOLK kernels are used, and nothing large lives on the
+     * thread stack.
+     */
+    class workspace : boost::noncopyable
+    {
+    public:
+      workspace() : d_base(NULL), d_size(0), d_used(0) {}
+      ~workspace() { volk_free(d_base); }
+
+      // Bytes taken by an array of n items, including the padding
+      template<class T>
+      static size_t bytes(size_t n)
+      {
+	const size_t a = volk_get_alignment();
+	return (n * sizeof(T) + a - 1) / a * a;
+      }
+
+      // Grows the arena to at least size bytes. Only allowed while no
+      // frame is open, since it moves the memory.
+      void reserve(size_t size)
+      {
+	if(size <= d_size) {
+	  return;
+	}
+	if(d_used != 0) {
+	  throw std::logic_error("workspace: reserve with arrays in use");
+	}
+	volk_free(d_base);
+	d_base = (char*)volk_malloc(size, volk_get_alignment());
+	if(!d_base) {
+	  d_size = 0;
+	  throw std::bad_alloc();
+	}
+	d_size = size;
+      }
+
+      template<class T>
+      T* alloc(size_t n)
+      {
+	const size_t b = bytes<T>(n);
+	if(d_used + b > d_size) {
+	  throw std::length_error("workspace: arena too small");
+	}
+	T *p = (T*)(d_base + d_used);
+	d_used += b;
+	return p;
+      }
+
+      size_t size() const { return d_size; }
+
+      /*!
+       * Releases everything allocated after its construction.
+       */
+      class frame
+      {
+      public:
+	frame(workspace &ws) : d_ws(ws), d_mark(ws.d_used) {}
+	~frame() { d_ws.d_used = d_mark; }
+
+      private:
+	workspace &d_ws;
+	size_t     d_mark;
+      };
+
+    private:
+      char   *d_base;
+      size_t  d_size;
+      size_t  d_used;
+    };
+
+  } /* namespace cbmc */
+} /* namespace gr */
+
+#endif /* INCLUDED_CBMC_WORKSPACE_H */
@@ -31,4 +31,5 @@ except ImportError:
 	pass
 
 # import any pure python here
+from probes import drain, taps_array
 #
@@ -0,0 +1,66 @@
+#
+# Copyright 2016 <+YOU OR YOUR COMPANY+>.
+#
+# This is free software; you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation; either version 3, or (at your option)
+# any later version.
+#
+# This software is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this software; see the file COPYING.  If not, write to
+# the Free Software Foundation, Inc., 51 Franklin Street,
+# Boston, MA 02110-1301, USA.
+#
+
+'''
+NumPy views of the probe and taps data of the CBMC blocks.
+
+The blocks copy their probe rings and filter banks into caller-owned
+buffers through the *_into() methods. A poller allocates one array per
+probe once and hands it to drain() on every call, so no Python list is
+built per value:
+
+    buf = numpy.empty(1024, dtype=numpy.float32)
+    while running:
+        f = cbmc.drain(det.drain_stored_freqs_into, buf)
+        plot(f)
+
+taps_array() returns the current filter bank of a my_pfb_clock_sync as
+a 2-D array.
+'''
+
+import numpy
+
+# Attempts of taps_array() before giving up; each one only fails if the
+# bank was swapped between reading its shape and copying its taps
+TAPS_ATTEMPTS = 4
+
+def drain(fill, out):
+    '''
+    Calls fill(out), one of the drain_stored_*_into() methods, and
+    returns the filled part of out.
+    '''
+    return out[:fill(out)]
+
+def taps_array(sync, derivative=False):
+    '''
+    Returns the filter bank of a my_pfb_clock_sync block as a
+    (nfilters, ntaps) float32 array, the derivative filters if
+    derivative is True.
+
+    A retune that swaps the bank between taps_shape() and the copy
+    changes the number of taps, the copy is then repeated with the new
+    shape. RuntimeError if the bank keeps changing.
+    '''
+    fill = sync.diff_taps_into if derivative else sync.taps_into
+    for _ in range(TAPS_ATTEMPTS):
+        out = numpy.empty(tuple(sync.taps_shape()), dtype=numpy.float32)
+        if fill(out) == out.size:
+            return out
+    raise RuntimeError('taps_array: filter bank changed during %d attempts'
+                       % TAPS_ATTEMPTS)
@@ -11,12 +11,50 @@
 #include "cbmc/modulation_classifier.h"
 #include "cbmc/freq_sps_det.h"
 #include "cbmc/my_pfb_clock_sync.h"
+#include "cbmc/my_pfb_clock_sync_mc.h"
+#include "cbmc/receiver.h"
 %}
 
 
+/*
+ * The *_into() methods fill a caller-owned buffer, so any writable
+ * C-contiguous object with the right item type (a numpy array, an
+ * array.array, ...) is accepted for (out, max) and filled in place.
+ */
+%define CBMC_BUFFER_TYPEMAP(TYPE, CODE)
+%typemap(in) (TYPE *out, size_t max) (Py_buffer view) {
+  if(PyObject_GetBuffer($input, &view,
+			PyBUF_WRITABLE | PyBUF_FORMAT | PyBUF_C_CONTIGUOUS) < 0)
+    SWIG_fail;
+  const char *fmt = view.format ? view.format : "B";
+  if(*fmt == '@' || *fmt == '=')
+    fmt++;
+  if(view.itemsize != sizeof(TYPE) || fmt[0] != CODE || fmt[1] != '\0') {
+    PyErr_SetString(PyExc_TypeError,
+		    "expected a writable contiguous buffer of " #TYPE);
+    PyBuffer_Release(&view);
+    SWIG_fail;
+  }
+  $1 = (TYPE *)view.buf;
+  $2 = view.len / sizeof(TYPE);
+}
+%typemap(freearg) (TYPE *out, size_t max) {
+  /* $1 is only set once the buffer has been accepted */
+  if($1)
+    PyBuffer_Release(&view$argnum);
+}
+%enddef
+
+CBMC_BUFFER_TYPEMAP(float, 'f')
+CBMC_BUFFER_TYPEMAP(unsigned int, 'I')
+
 %include "cbmc/modulation_classifier.h"
 GR_SWIG_BLOCK_MAGIC2(cbmc, modulation_classifier);
 %include "cbmc/freq_sps_det.h"
 GR_SWIG_BLOCK_MAGIC2(cbmc, freq_sps_det);
 %include "cbmc/my_pfb_clock_sync.h"
 GR_SWIG_BLOCK_MAGIC2(cbmc, my_pfb_clock_sync);
+%include "cbmc/my_pfb_clock_sync_mc.h"
+GR_SWIG_BLOCK_MAGIC2(cbmc, my_pfb_clock_sync_mc);
+%include "cbmc/receiver.h"
+GR_SWIG_BLOCK_MAGIC2(cbmc, receiver);